@@ -0,0 +1,143 @@
+/*
+ * Benchmarks the library's per-tick hot paths on the ESP32 and gates them against BenchmarkBaseline.h.
+ * The cases themselves live in BenchmarkCases.h, shared with the host benchmark in test/benchmark.cpp.
+ *
+ * WARNING: this arms the flight controller and drives real PWM signals on the motor pins. Remove the propellers or
+ * leave the ESCs unpowered.
+ *
+ * Results are printed over serial as a single line of JSON, followed by "BENCHMARK PASS" or "BENCHMARK FAIL".
+ * A benchmark without a recorded baseline fails, so record one for this board before relying on the gate.
+ * Send 'r' to run again or 'b' to print a new baseline table.
+ */
+
+#include <Arduino.h>
+#include "CycleCounter.h"
+#include "BenchmarkCases.h"
+#include "BenchmarkBaseline.h"
+
+#define BENCHMARK_ITERATIONS 2000
+#define BENCHMARK_WARMUP_ITERATIONS 100
+
+typedef struct
+{
+	uint32_t minCycles;
+	uint32_t meanCycles;
+	uint32_t maxCycles;
+} BenchmarkResult;
+
+BenchmarkResult results[NUM_BENCHMARKS];
+
+static void runBenchmark(const BenchmarkCase * benchmark, BenchmarkResult * result)
+{
+	uint64_t totalCycles = 0;
+
+	result->minCycles = UINT32_MAX;
+	result->maxCycles = 0;
+
+	for(uint32_t i = 0; i < BENCHMARK_WARMUP_ITERATIONS; i++)
+		benchmark->run(i);
+
+	for(uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++)
+	{
+		uint32_t start = readCycleCounter();
+		benchmark->run(i);
+		uint32_t cycles = readCycleCounter() - start;
+
+		totalCycles += cycles;
+
+		if(cycles < result->minCycles)
+			result->minCycles = cycles;
+
+		if(cycles > result->maxCycles)
+			result->maxCycles = cycles;
+	}
+
+	result->meanCycles = totalCycles / BENCHMARK_ITERATIONS;
+}
+
+static uint32_t findBaseline(const char * name)
+{
+	for(size_t i = 0; i < sizeof(benchmarkBaselines) / sizeof(benchmarkBaselines[0]); i++)
+	{
+		if(strcmp(benchmarkBaselines[i].name, name) == 0)
+			return benchmarkBaselines[i].meanCycles;
+	}
+
+	return 0;
+}
+
+static void runAll()
+{
+	bool allPassed = true;
+
+	Serial.printf("{\"iterations\":%u,\"tolerance_percent\":%u,\"cpu_mhz\":%u,\"benchmarks\":[",
+		BENCHMARK_ITERATIONS, BENCHMARK_TOLERANCE_PERCENT, (unsigned)getCpuFrequencyMhz());
+
+	for(size_t i = 0; i < NUM_BENCHMARKS; i++)
+	{
+		//Arm afresh for each case: only the control tick feeds the watchdog, so it may trip during the others and
+		//force the outputs low, which does not change the cost of the duty writes being timed
+		if(!armBenchmarks())
+		{
+			Serial.println("BENCHMARK could not arm the flight controller");
+			allPassed = false;
+		}
+
+		runBenchmark(&benchmarks[i], &results[i]);
+		fc.kill();
+
+		uint32_t baseline = findBaseline(benchmarks[i].name);
+		bool passed = baseline != 0 && results[i].meanCycles * 100 <= baseline * (100 + BENCHMARK_TOLERANCE_PERCENT);
+
+		allPassed = allPassed && passed;
+
+		Serial.printf("%s{\"name\":\"%s\",\"min\":%u,\"mean\":%u,\"max\":%u,\"baseline\":%u,\"pass\":%s}",
+			i ? "," : "", benchmarks[i].name, (unsigned)results[i].minCycles, (unsigned)results[i].meanCycles,
+			(unsigned)results[i].maxCycles, (unsigned)baseline, passed ? "true" : "false");
+	}
+
+	Serial.printf("],\"failsafe_detection_bound_us\":%u,\"failsafe_max_cutoff_cycles\":%u,\"telemetry_bytes_per_s\":%u,"
+		"\"pass\":%s}\n", (unsigned)failsafe.getWorstCaseDetectionUs(), (unsigned)failsafe.getMaxCutoffCycles(),
+		(unsigned)telemetry.getBytesPerSecond(), allPassed ? "true" : "false");
+	Serial.println(allPassed ? "BENCHMARK PASS" : "BENCHMARK FAIL");
+
+	failsafe.disable();
+	esc.start();
+}
+
+static void printBaseline()
+{
+	Serial.println("static const BenchmarkBaseline benchmarkBaselines[] =\n{");
+
+	for(size_t i = 0; i < NUM_BENCHMARKS; i++)
+		Serial.printf("\t{\"%s\", %u}%s\n", benchmarks[i].name, (unsigned)results[i].meanCycles, i + 1 < NUM_BENCHMARKS ? "," : "");
+
+	Serial.println("};");
+}
+
+void setup()
+{
+	Serial.begin(115200);
+
+	if(!setupBenchmarks())
+		Serial.println("BENCHMARK setup failed");
+
+	runAll();
+}
+
+void loop()
+{
+	if(Serial.available())
+	{
+		switch(Serial.read())
+		{
+			case 'r':
+				runAll();
+				break;
+
+			case 'b':
+				printBaseline();
+				break;
+		}
+	}
+}
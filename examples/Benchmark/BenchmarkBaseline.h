@@ -0,0 +1,33 @@
+#ifndef BENCHMARKBASELINE_H
+#define BENCHMARKBASELINE_H
+
+#include <stdint.h>
+
+//A benchmark fails when its mean exceeds the baseline mean by more than this percentage
+#define BENCHMARK_TOLERANCE_PERCENT 15
+
+typedef struct
+{
+	const char * name;
+	uint32_t meanCycles;
+} BenchmarkBaseline;
+
+/*
+ * Mean cycle counts recorded on a featheresp32 at 240MHz.
+ * A mean of 0 means no baseline has been recorded yet and the benchmark fails until one is.
+ * Send 'b' to the Benchmark sketch to print a replacement for this table from the current run.
+ */
+static const BenchmarkBaseline benchmarkBaselines[] =
+{
+	{"throttle_curve_lookup", 0},
+	{"esc_set_rpm", 0},
+	{"esc_set_thrust", 0},
+	{"accel_update", 0},
+	{"throttle_all", 0},
+	{"control_tick", 0},
+	{"failsafe_cutoff", 0},
+	{"telemetry_encode", 0},
+	{"flight_mode_dispatch", 0}
+};
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef BENCHMARKCASES_H
+#define BENCHMARKCASES_H
+
+/*
+ * The benchmark cases shared by the Benchmark sketch and the host benchmark in test/benchmark.cpp, so both time the
+ * same work. This defines the objects under test, so include it from a single source file.
+ *
+ * The control tick runs on its own simulated clock, advanced one tick per iteration. The accelerometer is a stand-in
+ * with a sample ready on every poll, so the cases time the library's own work rather than the I2C bus.
+ */
+
+#include "FlightController.h"
+#include "FlightMode.h"
+#include "Telemetry.h"
+#include "ThrottleCurve.h"
+
+#define BENCHMARK_TICK_MS 2
+#define BENCHMARK_READY_TIMEOUT_MS 5000
+
+typedef struct
+{
+	const char * name;
+	void (*run)(uint32_t iteration);
+} BenchmarkCase;
+
+/**
+ * @brief A sensor with a new sample on every poll, alternating between two small attitudes
+ */
+class StubAccelerometer : public BaseAccelerometer
+{
+protected:
+	uint32_t samples;
+
+public:
+	StubAccelerometer() : BaseAccelerometer(0)
+	{
+		this->samples = 0;
+	};
+
+	bool begin()
+	{
+		return true;
+	};
+
+	bool checkIdentity()
+	{
+		return true;
+	};
+
+	bool hasNewData()
+	{
+		this->samples++;
+		return true;
+	};
+
+	uint8_t read(uint8_t reg)
+	{
+		return reg;
+	};
+
+	void write(uint8_t reg, uint8_t data)
+	{
+		(void)reg;
+		(void)data;
+	};
+
+	float readPitch()
+	{
+		return this->samples % 2 ? .1f : -.1f;
+	};
+
+	float readRoll()
+	{
+		return this->samples % 2 ? -.1f : .1f;
+	};
+
+	float readYaw()
+	{
+		return 0;
+	};
+
+	float readAccelX()
+	{
+		return 0;
+	};
+
+	float readAccelY()
+	{
+		return 0;
+	};
+
+	float readAccelZ()
+	{
+		return 1;
+	};
+};
+
+StubAccelerometer sensor;
+Accelerometer accel(&sensor);
+
+FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+ESCControl esc(PIN_A0, MCPWM_UNIT_0, MCPWM_TIMER_2);
+ThrottleCurve curve(ESC_DEFAULT_FREQUENCY_HZ, ESC_DEFAULT_MIN_DUTY, ESC_DEFAULT_MAX_DUTY, ESC_DEFAULT_THRUST_EXPO);
+
+ESCControl * failsafeEscs[1] = {&esc};
+Failsafe failsafe(failsafeEscs, 1);
+
+FlightStateMachine modes;
+
+//Attitude at 100Hz, throttle at 50Hz and battery at 2Hz, simulated 10ms apart on each iteration
+TelemetryScheduler telemetry;
+int attitudeFields[3];
+int throttleField;
+int batteryField;
+uint32_t telemetryNowMs;
+
+uint32_t controlNowMs;
+
+volatile uint32_t benchmarkSink;
+
+//Sweep the commanded throttle so table lookups and duty writes see changing inputs
+static float sweep(uint32_t iteration)
+{
+	return (iteration % 1000) * .1f;
+}
+
+static void runThrottleCurveLookup(uint32_t iteration)
+{
+	benchmarkSink = curve.getPulseWidth(sweep(iteration));
+}
+
+static void runEscSetRPM(uint32_t iteration)
+{
+	esc.setRPMPercentage(sweep(iteration));
+}
+
+static void runEscSetThrust(uint32_t iteration)
+{
+	esc.setThrustPercentage(sweep(iteration));
+}
+
+static void runAccelUpdate(uint32_t iteration)
+{
+	(void)iteration;
+	benchmarkSink = accel.update();
+}
+
+//Needs the flight controller armed
+static void runThrottleAll(uint32_t iteration)
+{
+	fc.throttleAll(sweep(iteration));
+}
+
+//One armed control tick at 500Hz: housekeeping and an accelerometer sample, then command the motors
+static void runControlTick(uint32_t iteration)
+{
+	controlNowMs += BENCHMARK_TICK_MS;
+	fc.onCommand(controlNowMs);
+	fc.update(controlNowMs);
+	fc.throttleAll(sweep(iteration));
+}
+
+//A stalled loop: the watchdog interrupt fires until it trips and forces the output low
+static void runFailsafeCutoff(uint32_t iteration)
+{
+	(void)iteration;
+	failsafe.enable();
+
+	for(uint32_t i = 0; i < FAILSAFE_DEFAULT_MISSED_TICKS; i++)
+		failsafe.onWatchdogTimer();
+}
+
+//One telemetry tick: update the fields, encode whatever is due and acknowledge it
+static void runTelemetryEncode(uint32_t iteration)
+{
+	uint8_t frame[TELEMETRY_FRAME_SIZE];
+
+	for(int i = 0; i < 3; i++)
+		telemetry.setValue(attitudeFields[i], (int32_t)(iteration * (i + 1)) % 1800 - 900);
+
+	telemetry.setValue(throttleField, (int32_t)(sweep(iteration) * 10));
+	telemetry.setValue(batteryField, 12600 - iteration / 100);
+
+	telemetryNowMs += 10;
+
+	if(telemetry.buildFrame(telemetryNowMs, frame))
+		telemetry.acknowledge(frame[1]);
+}
+
+//A full arm cycle through the mode transition table
+static void runFlightModeDispatch(uint32_t iteration)
+{
+	modes.dispatch(EVENT_CALIBRATE, iteration);
+	modes.dispatch(EVENT_CHECKS_PASSED, iteration);
+	modes.dispatch(EVENT_ARM, iteration);
+	modes.dispatch(EVENT_DISARM, iteration);
+	benchmarkSink = modes.getMode();
+}
+
+static const BenchmarkCase benchmarks[] =
+{
+	{"throttle_curve_lookup", runThrottleCurveLookup},
+	{"esc_set_rpm", runEscSetRPM},
+	{"esc_set_thrust", runEscSetThrust},
+	{"accel_update", runAccelUpdate},
+	{"throttle_all", runThrottleAll},
+	{"control_tick", runControlTick},
+	{"failsafe_cutoff", runFailsafeCutoff},
+	{"telemetry_encode", runTelemetryEncode},
+	{"flight_mode_dispatch", runFlightModeDispatch}
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/**
+ * @brief Register the telemetry fields, start the benchmark ESC, attach the accelerometer and run control ticks until
+ * the pre-arm checks pass
+ *
+ * @return
+ * 		- true The flight controller is READY
+ * 		- false An ESC or the accelerometer failed to start, or the pre-arm checks did not pass in time
+ */
+static bool setupBenchmarks()
+{
+	for(int i = 0; i < 3; i++)
+		attitudeFields[i] = telemetry.addField(100, TELEMETRY_CRITICAL_PRIORITY);
+
+	throttleField = telemetry.addField(50, 100);
+	batteryField = telemetry.addField(2, 50);
+	telemetryNowMs = 0;
+
+	if(!esc.init() || !esc.start() || !fc.setAccelerometer(&accel) || !fc.init())
+		return false;
+
+	controlNowMs = 0;
+
+	while(fc.getMode() != MODE_READY && controlNowMs < BENCHMARK_READY_TIMEOUT_MS)
+	{
+		controlNowMs += BENCHMARK_TICK_MS;
+		fc.update(controlNowMs);
+	}
+
+	return fc.getMode() == MODE_READY;
+}
+
+/**
+ * @brief Arm the flight controller for the throttle and control tick cases
+ *
+ * @return
+ * 		- true Armed
+ * 		- false The flight controller refused to arm
+ */
+static bool armBenchmarks()
+{
+	fc.onCommand(controlNowMs);
+	return fc.arm();
+}
+
+#endif
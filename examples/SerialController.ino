@@ -1,12 +1,167 @@
 #include "FlightController.h"
+#include "Profiler.h"
 
 FlightController fc(33, 15, 32, 14);
 
+#define PARAMETER_LINE_LENGTH 64
+
+//The rest of an 's' command, built up across loop() calls so reading it never stalls the control loop
+char parameterLine[PARAMETER_LINE_LENGTH];
+int parameterLineLength;
+bool readingParameter = false;
+bool parameterLineTooLong;
+
+//Index of the next parameter to list, printed one per loop() call
+int listIndex = NUM_PARAMETERS;
+
 void setup()
 {
+	Serial.begin(115200);
 	fc.init();
 }
 
+//Handle "name value" to stage and commit a parameter change
+void setParameter(const char * text)
+{
+	ParameterStore * parameters = fc.getParameters();
+	String line = text;
+	ParameterId id;
+
+	//Skip the separator after 's' before splitting the rest of the line at the next space
+	line.trim();
+	int separator = line.indexOf(' ');
+	String name = separator < 0 ? line : line.substring(0, separator);
+	String value = separator < 0 ? String() : line.substring(separator + 1);
+
+	if(!parameters->find(name.c_str(), &id))
+	{
+		Serial.println("unknown parameter");
+		return;
+	}
+
+	ParameterResult result = parameters->setFromString(id, value.c_str());
+
+	if(result == PARAM_OK)
+		result = parameters->commit();
+
+	if(result == PARAM_OUT_OF_RANGE)
+		Serial.printf("%s: %s must be %g to %g\n", ParameterStore::getResultName(result), parameters->getName(id),
+			parameters->getMin(id), parameters->getMax(id));
+	else
+		Serial.println(ParameterStore::getResultName(result));
+}
+
+//Take whatever part of the parameter line has arrived, and handle it once the newline does
+void readParameterLine()
+{
+	while(Serial.available())
+	{
+		char c = Serial.read();
+
+		if(c == '\n')
+		{
+			parameterLine[parameterLineLength] = '\0';
+			readingParameter = false;
+
+			if(parameterLineTooLong)
+				Serial.println("line too long");
+			else
+				setParameter(parameterLine);
+
+			return;
+		}
+
+		if(parameterLineLength < PARAMETER_LINE_LENGTH - 1)
+			parameterLine[parameterLineLength++] = c;
+		else
+			parameterLineTooLong = true;
+	}
+}
+
+//Print the next parameter of a listing
+void listNextParameter()
+{
+	ParameterStore * parameters = fc.getParameters();
+	ParameterId id = (ParameterId)listIndex++;
+
+	if(parameters->getType(id) == PARAM_TYPE_INT)
+		Serial.printf("%s %d\n", parameters->getName(id), (int)parameters->getInt(id));
+	else
+		Serial.printf("%s %f\n", parameters->getName(id), parameters->getFloat(id));
+}
+
 void loop()
 {
+	//Feeds the watchdog and applies parameter changes staged over serial between control ticks
+	fc.update(millis());
+
+	//'a' arms once the pre-arm checks pass, 'k' kills, 'c' reruns the checks and 'm' prints the mode
+	//'s name value' sets a parameter, 'l' lists them and 'w' saves them
+	//Each call does a bounded amount of serial work, so a slow command cannot stall the loop past the watchdog
+	if(listIndex < NUM_PARAMETERS)
+		listNextParameter();
+
+	if(Serial.available())
+	{
+		fc.onCommand(millis());
+
+		if(readingParameter)
+		{
+			readParameterLine();
+			return;
+		}
+
+		switch(Serial.read())
+		{
+			case 'a':
+				Serial.println(fc.arm() ? "armed" : "arming refused");
+				break;
+
+			case 'k':
+				fc.kill();
+				break;
+
+			case 'c':
+				fc.calibrate();
+				break;
+
+			case 'm':
+				Serial.printf("%s failed=%s boot_to_ready_ms=%u\n", FlightStateMachine::getModeName(fc.getMode()),
+					fc.getFailedCheck() ? fc.getFailedCheck() : "none", (unsigned)fc.getBootToReadyMs());
+				break;
+
+			case 's':
+				parameterLineLength = 0;
+				parameterLineTooLong = false;
+				readingParameter = true;
+				readParameterLine();
+				break;
+
+			case 'l':
+				listIndex = 0;
+				break;
+
+			case 'w':
+				if(fc.getMode() == MODE_ARMED)
+					Serial.println("disarm before saving");
+				else
+					Serial.println(fc.saveParameters() ? "saved" : "save failed");
+				break;
+
+#ifdef FC_PROFILING
+			//'p' dumps the hot path timing histograms, 'r' clears them
+			//The dump is too long to print between control ticks, so it waits until the motors are disarmed
+			case 'p':
+				if(fc.getMode() == MODE_ARMED)
+					Serial.println("disarm before dumping");
+				else
+					Profiler::dump(Serial);
+				break;
+
+			case 'r':
+				Profiler::reset();
+				break;
+#endif
+		}
+	}
 }
\ No newline at end of file
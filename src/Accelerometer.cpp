@@ -21,13 +21,117 @@
 */
 
 #include "Accelerometer.h"
+#include "Profiler.h"
 
 Accelerometer::Accelerometer(SupportedSensor sensorType)
 {
 	this->sensorType = sensorType;
+	this->accel = 0;
+
+	this->pitchOffset = 0;
+	this->rollOffset = 0;
+	this->yawOffset = 0;
+	this->upwardAccelOffset = 0;
+	this->forwardAccelOffset = 0;
+	this->lrAccelOffset = 0;
+
+	this->currentPitch = 0;
+	this->currentRoll = 0;
+	this->currentYaw = 0;
+	this->currentUp = 0;
+	this->currentLeft = 0;
+	this->currentForward = 0;
 
 	/*switch(sensorType)
 	{
 		case MPU6050:
 	}*/
+}
+
+Accelerometer::Accelerometer(BaseAccelerometer * accel) : Accelerometer(MPU6050)
+{
+	this->accel = accel;
+}
+
+bool Accelerometer::hasDriver()
+{
+	return this->accel != 0;
+}
+
+bool Accelerometer::init()
+{
+	if(this->accel == 0)
+		return false;
+
+	return this->accel->begin();
+}
+
+bool Accelerometer::checkIdentity()
+{
+	if(this->accel == 0)
+		return false;
+
+	return this->accel->checkIdentity();
+}
+
+void Accelerometer::callibrate()
+{
+	if(this->accel == 0)
+		return;
+
+	//Treat the current attitude as level and the current acceleration as 1G straight up
+	this->pitchOffset = this->accel->readPitch();
+	this->rollOffset = this->accel->readRoll();
+	this->yawOffset = this->accel->readYaw();
+
+	this->forwardAccelOffset = this->accel->readAccelX();
+	this->lrAccelOffset = this->accel->readAccelY();
+	this->upwardAccelOffset = this->accel->readAccelZ() - 1.0f;
+}
+
+bool Accelerometer::update()
+{
+	FC_PROFILE_SCOPE(PROBE_ACCEL_UPDATE);
+
+	if(this->accel == 0 || !this->accel->hasNewData())
+		return false;
+
+	this->currentPitch = this->accel->readPitch() - this->pitchOffset;
+	this->currentRoll = this->accel->readRoll() - this->rollOffset;
+	this->currentYaw = this->accel->readYaw() - this->yawOffset;
+
+	this->currentForward = this->accel->readAccelX() - this->forwardAccelOffset;
+	this->currentLeft = this->accel->readAccelY() - this->lrAccelOffset;
+	this->currentUp = this->accel->readAccelZ() - this->upwardAccelOffset;
+	return true;
+}
+
+float Accelerometer::getPitch()
+{
+	return this->currentPitch;
+}
+
+float Accelerometer::getRoll()
+{
+	return this->currentRoll;
+}
+
+float Accelerometer::getYaw()
+{
+	return this->currentYaw;
+}
+
+float Accelerometer::getAccelForward()
+{
+	return this->currentForward;
+}
+
+float Accelerometer::getAccelLR()
+{
+	return this->currentLeft;
+}
+
+float Accelerometer::getAccelZ()
+{
+	return this->currentUp;
 }
\ No newline at end of file
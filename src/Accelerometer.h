@@ -69,6 +69,22 @@ public:
 	 */
 	Accelerometer(SupportedSensor sensorType);
 
+	/**
+	 * @brief Use an already constructed sensor driver
+	 *
+	 * @param accel The driver to read from
+	 */
+	Accelerometer(BaseAccelerometer * accel);
+
+	/**
+	 * @brief Check whether there is a driver for the sensor to read from
+	 *
+	 * @return
+	 * 		- true a driver is attached
+	 * 		- false the sensor type has no driver, every read fails
+	 */
+	bool hasDriver();
+
 	/**
 	 * @brief Attempt to initialize communication with the given accelerometer
 	 *
@@ -78,15 +94,28 @@ public:
 	 */
 	bool init();
 
+	/**
+	 * @brief Check that the connected sensor identifies itself as the expected type
+	 *
+	 * @return
+	 * 		- true sensor identified
+	 * 		- false sensor missing or unexpected
+	 */
+	bool checkIdentity();
+
 	/**
 	 * @brief Callibrate the accelerometer by getting current values assuming the drone is on a perfectly flat surface and not moving
 	 */
 	void callibrate();
 
 	/**
-	 * @brief Read all angles and accelerations and store locally
+	 * @brief Read all angles and accelerations and store locally if the sensor has a new sample
+	 *
+	 * @return
+	 * 		- true a new sample was read
+	 * 		- false no new sample, the previous values are kept
 	 */
-	void update();
+	bool update();
 
 	/**
 	 * @brief Get the current pitch angle in degrees
@@ -53,7 +53,25 @@ public:
 	 * 		- true accelerometer activated
 	 * 		- accelerometer unavailable
 	 */
-	virtual bool begin();
+	virtual bool begin() = 0;
+
+	/**
+	 * @brief Check that the device answering at the I2C address is the expected sensor
+	 * 
+	 * @return
+	 * 		- true the sensor identified itself correctly
+	 * 		- false the sensor is missing or a different device
+	 */
+	virtual bool checkIdentity() = 0;
+
+	/**
+	 * @brief Check whether the sensor has taken a sample since the last read
+	 * 
+	 * @return
+	 * 		- true a new sample is ready
+	 * 		- false the values would repeat the last sample
+	 */
+	virtual bool hasNewData() = 0;
 
 	/**
 	 * @brief Read a byte from the accelerometer at a given register
@@ -62,7 +80,7 @@ public:
 	 *
 	 * @return The byte stored in the given accelerometer register
 	 */
-	virtual uint8_t read(uint8_t reg);
+	virtual uint8_t read(uint8_t reg) = 0;
 	
 	/**
 	 * @brief Write a byte to an accelerometer register
@@ -70,49 +88,49 @@ public:
 	 * @param reg The register location to write to
 	 * @param data The byte to write to the register
 	 */
-	virtual void write(uint8_t reg, uint8_t data);
+	virtual void write(uint8_t reg, uint8_t data) = 0;
 
 	/**
 	 * @brief Read the current pitch angle in degrees
 	 *
 	 * @return The current pitch in degrees
 	 */
-	virtual float readPitch();
+	virtual float readPitch() = 0;
 
 	/**
 	 * @brief Read the current roll angle in degrees
 	 *
 	 * @return The current roll angle in degrees
 	 */
-	virtual float readRoll();
+	virtual float readRoll() = 0;
 
 	/**
 	 * @brief Read the current yaw offset from startup in degrees
 	 *
 	 * @return The current yaw angle in degrees
 	 */
-	virtual float readYaw();
+	virtual float readYaw() = 0;
 
 	/**
 	 * @brief Read the current forward acceleration (Gs)
 	 *
 	 * @return The current forward acceleration as compared to 1G
 	 */
-	virtual float readAccelX();
+	virtual float readAccelX() = 0;
 
 	/**
 	 * @brief Read the current left-right acceleration (Gs)
 	 *
 	 * @return The current left-right acceleration as compared to 1G (left is positive)
 	 */
-	virtual float readAccelY();
+	virtual float readAccelY() = 0;
 
 	/**
 	 * @brief Read the current upward acceleration (Gs)
 	 *
 	 * @return The current upward acceleration as compared to 1G
 	 */
-	virtual float readAccelZ();
+	virtual float readAccelZ() = 0;
 
 };
 
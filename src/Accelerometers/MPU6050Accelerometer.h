@@ -32,7 +32,10 @@
 #define MPU6050_GYRO_CONFIG 0x1b
 #define MPU6050_ACCEL_CONFIG 0x1c
 #define MPU6050_WHO_AM_I 0x75
+#define MPU6050_WHO_AM_I_VALUE 0x68
 #define MPU6050_PWR_MGMT_1 0x6b
+#define MPU6050_INT_STATUS 0x3a
+#define MPU6050_DATA_RDY_INT 0x01
 #define MPU6050_TEMP_H 0x41
 #define MPU6050_TEMP_L 0x42
 
@@ -49,7 +52,18 @@ public:
 
 	bool begin()
 	{
+		return false;
+	};
 
+	bool checkIdentity()
+	{
+		return this->read(MPU6050_WHO_AM_I) == MPU6050_WHO_AM_I_VALUE;
+	};
+
+	bool hasNewData()
+	{
+		//Reading INT_STATUS clears the data ready flag
+		return (this->read(MPU6050_INT_STATUS) & MPU6050_DATA_RDY_INT) != 0;
 	};
 };
 
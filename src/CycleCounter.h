@@ -0,0 +1,58 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef CYCLECOUNTER_H
+#define CYCLECOUNTER_H
+
+#include <stdint.h>
+
+#if defined(__XTENSA__)
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * @brief Read a free-running cycle counter for timing short sections of code
+ *
+ * Uses the CCOUNT register on the ESP32, the timestamp counter on x86 hosts and the monotonic clock in nanoseconds elsewhere.
+ * The counter wraps, so only the unsigned difference between two close readings is meaningful.
+ *
+ * @return The current counter value
+ */
+static inline uint32_t readCycleCounter()
+{
+#if defined(__XTENSA__)
+	uint32_t cycles;
+	__asm__ __volatile__("rsr %0, ccount" : "=a"(cycles));
+	return cycles;
+#elif defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000000000ull + now.tv_nsec);
+#endif
+}
+
+#endif
@@ -21,13 +21,19 @@
 */
 
 #include "ESCControl.h"
+#include "Profiler.h"
 
 ESCControl::ESCControl(int escPin, mcpwm_unit_t pwmUnit, mcpwm_timer_t pwmTimer)
+	: thrustCurve(ESC_DEFAULT_FREQUENCY_HZ, ESC_DEFAULT_MIN_DUTY, ESC_DEFAULT_MAX_DUTY, ESC_DEFAULT_THRUST_EXPO)
 {
 	this->escPin = escPin;
 	this->pwmUnit = pwmUnit;
 	this->pwmTimer = pwmTimer;
-	this->activeDuty = 0;
+	this->activePulseWidth = 0;
+	this->initialized = false;
+	this->frequency = ESC_DEFAULT_FREQUENCY_HZ;
+	this->minDuty = ESC_DEFAULT_MIN_DUTY;
+	this->maxDuty = ESC_DEFAULT_MAX_DUTY;
 
 	this->confData.frequency = ESC_DEFAULT_FREQUENCY_HZ;
 	this->confData.cmpr_a = 0.0;
@@ -48,6 +54,23 @@ ESCControl::ESCControl(int escPin, mcpwm_unit_t pwmUnit, mcpwm_timer_t pwmTimer)
 		default:
 			this->mcpwmSignal = MCPWM2A;
 	}
+
+#ifdef ESP32
+	//Operator n is paired with timer n by mcpwm_init, and ESCs always use its generator A
+	switch(pwmTimer)
+	{
+		case MCPWM_TIMER_0:
+			this->forceRegister = (volatile uint32_t *)MCPWM_GEN0_FORCE_REG(pwmUnit);
+			break;
+
+		case MCPWM_TIMER_1:
+			this->forceRegister = (volatile uint32_t *)MCPWM_GEN1_FORCE_REG(pwmUnit);
+			break;
+
+		default:
+			this->forceRegister = (volatile uint32_t *)MCPWM_GEN2_FORCE_REG(pwmUnit);
+	}
+#endif
 }
 
 bool ESCControl::init()
@@ -60,43 +83,127 @@ bool ESCControl::init()
 	if(mcpwm_init(this->pwmUnit, this->pwmTimer, &this->confData) != ESP_OK)
 		return false;
 
-	//Set the default frequency
-	if (mcpwm_set_frequency(this->pwmUnit, this->pwmTimer, ESC_DEFAULT_FREQUENCY_HZ) != ESP_OK)
+	//Set the configured frequency
+	if (mcpwm_set_frequency(this->pwmUnit, this->pwmTimer, this->frequency) != ESP_OK)
+		return false;
+
+	this->initialized = true;
+	return true;
+}
+
+bool ESCControl::isInitialized()
+{
+	return this->initialized;
+}
+
+bool ESCControl::configure(uint32_t frequency, float minDuty, float maxDuty, float thrustExpo)
+{
+	//A zero frequency has no period and an empty or inverted duty range has no usable throttle
+	if(frequency == 0 || !(minDuty > 0 && minDuty < maxDuty && maxDuty < 100))
 		return false;
 
+	if(frequency != this->frequency)
+	{
+		if(this->initialized && mcpwm_set_frequency(this->pwmUnit, this->pwmTimer, frequency) != ESP_OK)
+			return false;
+
+		this->frequency = frequency;
+		this->confData.frequency = frequency;
+	}
+
+	this->minDuty = minDuty;
+	this->maxDuty = maxDuty;
+	this->thrustCurve.configure(frequency, minDuty, maxDuty, thrustExpo);
 	return true;
 }
 
 bool ESCControl::start()
 {
-	return mcpwm_start(this->pwmUnit, this->pwmTimer) == ESP_OK;
+	this->setForceMode(ESC_FORCE_DISABLED);
+
+	if(!((mcpwm_set_duty(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A, 0) == ESP_OK) &&
+		(mcpwm_set_duty_type(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A, this->confData.duty_mode) == ESP_OK) &&
+		(mcpwm_start(this->pwmUnit, this->pwmTimer) == ESP_OK)))
+		return false;
+
+	this->activePulseWidth = 0;
+	return true;
 }
 
 bool ESCControl::stop()
 {
-	return (mcpwm_set_duty(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A, 0) == ESP_OK) && (mcpwm_stop(this->pwmUnit, this->pwmTimer) == ESP_OK);
+	if(!((mcpwm_set_duty(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A, 0) == ESP_OK) && (mcpwm_stop(this->pwmUnit, this->pwmTimer) == ESP_OK)))
+		return false;
+
+	this->activePulseWidth = 0;
+	return true;
+}
+
+void IRAM_ATTR ESCControl::setForceMode(uint32_t mode)
+{
+#ifdef ESP32
+	//The three generator force registers share the GEN0 field layout, with an update method of 0 applying immediately
+	uint32_t force = *this->forceRegister;
+	force &= ~((MCPWM_GEN0_A_CNTUFORCE_MODE_V << MCPWM_GEN0_A_CNTUFORCE_MODE_S) |
+		(MCPWM_GEN0_CNTU_FORCE_UPMETHOD_V << MCPWM_GEN0_CNTU_FORCE_UPMETHOD_S));
+	*this->forceRegister = force | (mode << MCPWM_GEN0_A_CNTUFORCE_MODE_S);
+#else
+	(void)mode;
+#endif
+}
+
+bool IRAM_ATTR ESCControl::forceOff()
+{
+#ifdef ESP32
+	this->setForceMode(ESC_FORCE_LOW);
+	return true;
+#else
+	return mcpwm_set_signal_low(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A) == ESP_OK;
+#endif
 }
 
 bool ESCControl::setRPMPercentage(float rpmPercentage)
 {
+	FC_PROFILE_SCOPE(PROBE_ESC_SET_RPM);
+
 	if(rpmPercentage > 100)
 		rpmPercentage = 100.0;
 	else if(rpmPercentage < 0)
 		rpmPercentage = 0.0;
 
-	float previousActiveDuty = this->activeDuty;
+	uint32_t pulseWidth = 0;
 
-	//Turn off completely on 0 input
-	if(rpmPercentage < .01)
-		this->activeDuty = 0;
-	else
-		this->activeDuty = (ESC_DEFAULT_MAX_DUTY - ESC_DEFAULT_MIN_DUTY) * .01 * rpmPercentage + ESC_DEFAULT_MIN_DUTY;
-
-	if (mcpwm_set_duty(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A, this->activeDuty) != ESP_OK)
+	//Turn off completely on 0 input, otherwise convert the duty percentage to microseconds of the PWM period
+	if(rpmPercentage >= .01)
 	{
-		this->activeDuty = previousActiveDuty;
-		return false;
+		float duty = (this->maxDuty - this->minDuty) * .01 * rpmPercentage + this->minDuty;
+		pulseWidth = (uint32_t)(duty * 10000.0f / this->frequency + .5f);
 	}
 
+	return this->setPulseWidth(pulseWidth);
+}
+
+bool ESCControl::setThrustPercentage(float thrustPercentage)
+{
+	FC_PROFILE_SCOPE(PROBE_ESC_SET_THRUST);
+	return this->setPulseWidth(this->thrustCurve.getPulseWidth(thrustPercentage));
+}
+
+bool ESCControl::setPulseWidth(uint32_t pulseWidth)
+{
+	if(mcpwm_set_duty_in_us(this->pwmUnit, this->pwmTimer, MCPWM_OPR_A, pulseWidth) != ESP_OK)
+		return false;
+
+	this->activePulseWidth = pulseWidth;
 	return true;
+}
+
+uint32_t ESCControl::getPulseWidth()
+{
+	return this->activePulseWidth;
+}
+
+ThrottleCurve * ESCControl::getThrottleCurve()
+{
+	return &this->thrustCurve;
 }
\ No newline at end of file
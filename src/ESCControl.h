@@ -24,11 +24,21 @@
 #define ESCCONTROL_H
 
 #include <driver/mcpwm.h>
+#include "ThrottleCurve.h"
+#include "Parameters.h"
+
+#ifdef ESP32
+#include <esp_attr.h>
+#include <soc/mcpwm_reg.h>
+#elif !defined(IRAM_ATTR)
+#define IRAM_ATTR
+#endif
+
+//Continuous software force modes of an MCPWM generator output
+#define ESC_FORCE_DISABLED 0
+#define ESC_FORCE_LOW 1
 
 #define ESC_DEFAULT_PERIOD_S .02
-#define ESC_DEFAULT_FREQUENCY_HZ 50
-#define ESC_DEFAULT_MIN_DUTY 5
-#define ESC_DEFAULT_MAX_DUTY 10
 
 /**
  * @brief Enumeration of MCPWM capable pins on the Adafruit ESP32 Feather
@@ -64,12 +74,46 @@ protected:
 	//The configuration settings for the PWM unit
 	mcpwm_config_t confData;
 
-	//The active duty percentage for this ESC
-	float activeDuty;
+	//Whether the MCPWM unit has been set up by init()
+	bool initialized;
+
+	//The PWM frequency and the duty percentages at zero and full throttle
+	uint32_t frequency;
+	float minDuty;
+	float maxDuty;
 
 	//The timer + operator being used for this ESC
 	mcpwm_io_signals_t mcpwmSignal;
 
+#ifdef ESP32
+	//Force register of the generator driving this ESC, written directly so cutoff works from an IRAM interrupt
+	volatile uint32_t * forceRegister;
+#endif
+
+	/**
+	 * @brief Set the continuous software force mode of this ESC's generator output
+	 * 
+	 * @param mode ESC_FORCE_LOW to hold the output low or ESC_FORCE_DISABLED to release it
+	 */
+	void IRAM_ATTR setForceMode(uint32_t mode);
+
+	/**
+	 * @brief Send a pulse width to the ESC and record it as the active output
+	 * 
+	 * @param pulseWidth The pulse width in microseconds, 0 for off
+	 * 
+	 * @return
+	 *      - true Successful output change
+	 *      - false Output change failed, the active output is unchanged
+	 */
+	bool setPulseWidth(uint32_t pulseWidth);
+
+	//Lookup table converting thrust percentages to pulse widths
+	ThrottleCurve thrustCurve;
+
+	//The active pulse width in microseconds, the only record of the ESC output whichever setter drove it
+	uint32_t activePulseWidth;
+
 public:
 	/**
 	 * @brief Setup specified PWM pin using a given MCPWM unit and timer 
@@ -90,7 +134,32 @@ public:
 	bool init();
 
 	/**
-	 * @brief Activate the PWM output in current configuration
+	 * @brief Check whether init() has set up the MCPWM unit
+	 * 
+	 * @return
+	 *     - true Initialized
+	 *     - false Not initialized or initialization failed
+	 */
+	bool isInitialized();
+
+	/**
+	 * @brief Change the PWM frequency, duty range and thrust curve, before or after init()
+	 * 
+	 * A measured thrust curve is kept unless the expo changes.
+	 * 
+	 * @param frequency The PWM frequency in Hz
+	 * @param minDuty The duty percentage at which the motor begins to spin
+	 * @param maxDuty The duty percentage at full throttle
+	 * @param thrustExpo The quadratic share of the thrust curve, 0 is linear and 1 is pure quadratic
+	 * 
+	 * @return
+	 *     - true Configuration changed
+	 *     - false Invalid frequency or duty range, or frequency change failed, configuration unchanged
+	 */
+	bool configure(uint32_t frequency, float minDuty, float maxDuty, float thrustExpo);
+
+	/**
+	 * @brief Activate the PWM output in current configuration at zero throttle, releasing any forced cutoff
 	 * 
 	 * @return
 	 *     - true Successful start
@@ -107,6 +176,18 @@ public:
 	 */
 	bool stop();
 
+	/**
+	 * @brief Immediately hold the PWM output low, cutting the ESC off until the next start
+	 * 
+	 * Safe to call from an IRAM interrupt while the flash cache is disabled, as it writes the generator
+	 * force register directly instead of calling the driver.
+	 * 
+	 * @return
+	 *     - true Output forced low
+	 *     - false Cutoff failed
+	 */
+	bool IRAM_ATTR forceOff();
+
 	/**
 	 * @brief Set the RPM percentage
 	 * 
@@ -117,6 +198,31 @@ public:
 	 *      - false Speed change failed
 	 */
 	bool setRPMPercentage(float rpmPercentage);
+
+	/**
+	 * @brief Set the thrust percentage using the calibrated throttle curve
+	 * 
+	 * @param thrustPercentage The percentage of full thrust to produce, 0 is off and 100 is max
+	 * 
+	 * @return
+	 *      - true Successful speed change
+	 *      - false Speed change failed
+	 */
+	bool setThrustPercentage(float thrustPercentage);
+
+	/**
+	 * @brief Get the throttle curve used by setThrustPercentage for calibration
+	 * 
+	 * @return The throttle curve of this ESC
+	 */
+	ThrottleCurve * getThrottleCurve();
+
+	/**
+	 * @brief Get the pulse width currently sent to the ESC
+	 * 
+	 * @return The active pulse width in microseconds, 0 for off
+	 */
+	uint32_t getPulseWidth();
 };
 
 #endif
\ No newline at end of file
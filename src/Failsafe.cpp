@@ -0,0 +1,226 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "Failsafe.h"
+#include "CycleCounter.h"
+
+#ifdef ARDUINO
+//The failsafe serviced by the watchdog timer interrupt
+static Failsafe * watchdogOwner = 0;
+
+static void IRAM_ATTR watchdogInterrupt()
+{
+	if(watchdogOwner != 0)
+		watchdogOwner->onWatchdogTimer();
+}
+#endif
+
+Failsafe::Failsafe(ESCControl ** escs, uint8_t numEscs)
+{
+	this->escs = escs;
+	this->numEscs = numEscs;
+
+#ifdef ARDUINO
+	this->timer = 0;
+#endif
+
+	this->periodUs = FAILSAFE_DEFAULT_PERIOD_US;
+	this->missedTickLimit = FAILSAFE_DEFAULT_MISSED_TICKS;
+	this->missedTicks = 0;
+	this->enabled = false;
+	this->tripped = false;
+	this->lastCutoffCycles = 0;
+	this->maxCutoffCycles = 0;
+
+	this->holdAfterMs = FAILSAFE_DEFAULT_HOLD_MS;
+	this->descendAfterMs = FAILSAFE_DEFAULT_DESCEND_MS;
+	this->disarmAfterMs = FAILSAFE_DEFAULT_DISARM_MS;
+	this->imuStaleMs = FAILSAFE_DEFAULT_IMU_STALE_MS;
+
+	this->lastCommandMs = 0;
+	this->lastImuMs = 0;
+	this->imuSeen = false;
+	this->restartLinkTimer = true;
+}
+
+bool Failsafe::begin()
+{
+#ifdef ARDUINO
+	if(this->timer == 0)
+	{
+		this->timer = timerBegin(FAILSAFE_TIMER_NUM, FAILSAFE_TIMER_DIVIDER, true);
+
+		if(this->timer == 0)
+			return false;
+
+		watchdogOwner = this;
+		timerAttachInterrupt(this->timer, &watchdogInterrupt, true);
+	}
+
+	timerAlarmWrite(this->timer, this->periodUs, true);
+#endif
+
+	return true;
+}
+
+void Failsafe::setWatchdog(uint32_t periodUs, uint32_t missedTicks)
+{
+	this->periodUs = periodUs;
+	this->missedTickLimit = missedTicks;
+
+#ifdef ARDUINO
+	if(this->timer != 0)
+		timerAlarmWrite(this->timer, periodUs, true);
+#endif
+}
+
+void Failsafe::setLinkTimeouts(uint32_t holdAfterMs, uint32_t descendAfterMs, uint32_t disarmAfterMs)
+{
+	this->holdAfterMs = holdAfterMs;
+	this->descendAfterMs = descendAfterMs;
+	this->disarmAfterMs = disarmAfterMs;
+}
+
+void Failsafe::setImuTimeout(uint32_t staleMs)
+{
+	this->imuStaleMs = staleMs;
+}
+
+void Failsafe::enable()
+{
+	this->missedTicks = 0;
+	this->tripped = false;
+	this->restartLinkTimer = true;
+	this->enabled = true;
+
+#ifdef ARDUINO
+	if(this->timer != 0)
+		timerAlarmEnable(this->timer);
+#endif
+}
+
+void Failsafe::disable()
+{
+	this->enabled = false;
+
+#ifdef ARDUINO
+	if(this->timer != 0)
+		timerAlarmDisable(this->timer);
+#endif
+}
+
+void Failsafe::onCommand(uint32_t nowMs)
+{
+	this->lastCommandMs = nowMs;
+	this->restartLinkTimer = false;
+}
+
+void Failsafe::onImuSample(uint32_t nowMs)
+{
+	this->lastImuMs = nowMs;
+	this->imuSeen = true;
+}
+
+FailsafeAction Failsafe::evaluate(uint32_t nowMs)
+{
+	if(this->restartLinkTimer)
+	{
+		this->lastCommandMs = nowMs;
+		this->restartLinkTimer = false;
+	}
+
+	if(this->tripped)
+		return FAILSAFE_DISARM;
+
+	//An IMU that has never reported is left to the pre-arm checks
+	if(this->imuStaleMs != 0 && this->imuSeen && nowMs - this->lastImuMs > this->imuStaleMs)
+		return FAILSAFE_DISARM;
+
+	uint32_t sinceCommand = nowMs - this->lastCommandMs;
+
+	if(sinceCommand >= this->disarmAfterMs)
+		return FAILSAFE_DISARM;
+
+	if(sinceCommand >= this->descendAfterMs)
+		return FAILSAFE_DESCEND;
+
+	if(sinceCommand >= this->holdAfterMs)
+		return FAILSAFE_HOLD;
+
+	return FAILSAFE_NONE;
+}
+
+void IRAM_ATTR Failsafe::onWatchdogTimer()
+{
+	if(!this->enabled || this->tripped)
+		return;
+
+	uint32_t missed = this->missedTicks + 1;
+	this->missedTicks = missed;
+
+	if(missed < this->missedTickLimit)
+		return;
+
+	this->tripped = true;
+
+	uint32_t start = readCycleCounter();
+	this->cutoff();
+	uint32_t cycles = readCycleCounter() - start;
+
+	this->lastCutoffCycles = cycles;
+
+	if(cycles > this->maxCutoffCycles)
+		this->maxCutoffCycles = cycles;
+}
+
+bool IRAM_ATTR Failsafe::cutoff()
+{
+	bool success = true;
+
+	for(uint8_t i = 0; i < this->numEscs; i++)
+	{
+		if(this->escs[i] != 0)
+			success = this->escs[i]->forceOff() && success;
+	}
+
+	return success;
+}
+
+bool Failsafe::isTripped()
+{
+	return this->tripped;
+}
+
+uint32_t Failsafe::getWorstCaseDetectionUs()
+{
+	return this->missedTickLimit * this->periodUs;
+}
+
+uint32_t Failsafe::getLastCutoffCycles()
+{
+	return this->lastCutoffCycles;
+}
+
+uint32_t Failsafe::getMaxCutoffCycles()
+{
+	return this->maxCutoffCycles;
+}
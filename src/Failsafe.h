@@ -0,0 +1,227 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef FAILSAFE_H
+#define FAILSAFE_H
+
+#include <stdint.h>
+#include "ESCControl.h"
+#include "Parameters.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+//Hardware timer used by the watchdog, ticking at 1MHz from the 80MHz APB clock
+#define FAILSAFE_TIMER_NUM 0
+#define FAILSAFE_TIMER_DIVIDER 80
+
+/**
+ * @brief Response requested by the failsafe, in order of severity
+ */
+typedef enum
+{
+	FAILSAFE_NONE = 0,
+	FAILSAFE_HOLD,
+	FAILSAFE_DESCEND,
+	FAILSAFE_DISARM
+} FailsafeAction;
+
+/**
+ * @brief Loop watchdog and link/sensor loss detection for a set of ESCs
+ *
+ * While enabled, a hardware timer counts watchdog periods since the control loop last called feed().
+ * Once that reaches the missed tick limit, the timer interrupt forces every ESC output low, so outputs are cut
+ * at most missedTicks * periodUs after the last feed. The interrupt and the cutoff run from IRAM and set each
+ * MCPWM generator's force register directly, so the cutoff still works while the flash cache is disabled.
+ * Saving parameters is still refused while armed, since an NVS write stalls the loop and would trip the watchdog.
+ */
+class Failsafe
+{
+protected:
+	//The ESCs to cut off, shared with the owner
+	ESCControl ** escs;
+	uint8_t numEscs;
+
+#ifdef ARDUINO
+	hw_timer_t * timer;
+#endif
+
+	uint32_t periodUs;
+	uint32_t missedTickLimit;
+
+	//Watchdog periods since the last feed, cleared by the control loop and counted up by the timer interrupt
+	volatile uint32_t missedTicks;
+	volatile bool enabled;
+	volatile bool tripped;
+
+	//Cycles the most recent and slowest watchdog cutoffs took to force every output low
+	volatile uint32_t lastCutoffCycles;
+	volatile uint32_t maxCutoffCycles;
+
+	//Link and sensor loss thresholds in milliseconds since the last command or sample
+	uint32_t holdAfterMs;
+	uint32_t descendAfterMs;
+	uint32_t disarmAfterMs;
+	uint32_t imuStaleMs;
+
+	uint32_t lastCommandMs;
+	uint32_t lastImuMs;
+	bool imuSeen;
+
+	//Set on enable so link timing restarts at the next evaluate
+	bool restartLinkTimer;
+
+public:
+	/**
+	 * @brief Set up a failsafe for a set of ESCs with default thresholds
+	 *
+	 * @param escs The ESCs to cut off, the array may be filled in after construction
+	 * @param numEscs The number of ESCs in the array
+	 */
+	Failsafe(ESCControl ** escs, uint8_t numEscs);
+
+	/**
+	 * @brief Allocate the watchdog's hardware timer, leaving the watchdog disabled
+	 *
+	 * @return
+	 * 		- true timer ready
+	 * 		- false timer unavailable
+	 */
+	bool begin();
+
+	/**
+	 * @brief Set the watchdog period and the number of periods the loop may miss before cutoff
+	 *
+	 * @param periodUs The watchdog period in microseconds
+	 * @param missedTicks The number of periods without a feed that trigger the cutoff
+	 */
+	void setWatchdog(uint32_t periodUs, uint32_t missedTicks);
+
+	/**
+	 * @brief Set the link loss stages, each measured from the last command
+	 *
+	 * @param holdAfterMs Time until the aircraft holds its current throttle
+	 * @param descendAfterMs Time until the aircraft starts descending
+	 * @param disarmAfterMs Time until the motors are disarmed
+	 */
+	void setLinkTimeouts(uint32_t holdAfterMs, uint32_t descendAfterMs, uint32_t disarmAfterMs);
+
+	/**
+	 * @brief Set how old the latest IMU sample may be before disarming, 0 disables the check
+	 *
+	 * @param staleMs The maximum IMU sample age in milliseconds
+	 */
+	void setImuTimeout(uint32_t staleMs);
+
+	/**
+	 * @brief Clear any trip and start the watchdog, call when arming
+	 */
+	void enable();
+
+	/**
+	 * @brief Stop the watchdog, call when disarming
+	 */
+	void disable();
+
+	/**
+	 * @brief Tell the watchdog the control loop is alive, call once every control tick
+	 */
+	inline void feed()
+	{
+		this->missedTicks = 0;
+	}
+
+	/**
+	 * @brief Record that a command arrived over the link
+	 *
+	 * @param nowMs The current time in milliseconds
+	 */
+	void onCommand(uint32_t nowMs);
+
+	/**
+	 * @brief Record that a fresh IMU sample was read
+	 *
+	 * @param nowMs The current time in milliseconds
+	 */
+	void onImuSample(uint32_t nowMs);
+
+	/**
+	 * @brief Decide how the aircraft should respond to the current link and sensor state
+	 *
+	 * @param nowMs The current time in milliseconds
+	 *
+	 * @return The most severe action currently required
+	 */
+	FailsafeAction evaluate(uint32_t nowMs);
+
+	/**
+	 * @brief Count one watchdog period and cut off the ESCs once the loop has missed too many, called by the timer interrupt
+	 */
+	void IRAM_ATTR onWatchdogTimer();
+
+	/**
+	 * @brief Force every ESC output low, attempting all of them even if one fails
+	 *
+	 * Runs from IRAM without driver or log calls, so the watchdog can cut off while the flash cache is disabled.
+	 *
+	 * @return
+	 * 		- true every output forced low
+	 * 		- false at least one output failed
+	 */
+	bool IRAM_ATTR cutoff();
+
+	/**
+	 * @brief Check whether the watchdog has cut off the ESCs since it was last enabled
+	 *
+	 * @return
+	 * 		- true the watchdog cut off the ESCs
+	 * 		- false the control loop has kept up
+	 */
+	bool isTripped();
+
+	/**
+	 * @brief Get the configured bound on the time from the last feed until the outputs are cut, excluding the cutoff itself
+	 *
+	 * The bound is missed ticks times the watchdog period. test/test_failsafe.cpp measures the real latency
+	 * against it in a simulation with loop jitter and every stall phase.
+	 *
+	 * @return The worst case detection latency in microseconds
+	 */
+	uint32_t getWorstCaseDetectionUs();
+
+	/**
+	 * @brief Get the number of cycles the most recent watchdog cutoff took to force every output low
+	 *
+	 * @return The cutoff duration in cycles
+	 */
+	uint32_t getLastCutoffCycles();
+
+	/**
+	 * @brief Get the number of cycles the slowest watchdog cutoff took to force every output low
+	 *
+	 * @return The cutoff duration in cycles
+	 */
+	uint32_t getMaxCutoffCycles();
+};
+
+#endif
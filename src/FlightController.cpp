@@ -21,8 +21,56 @@
 */
 
 #include "FlightController.h"
+#include "Profiler.h"
+
+const FlightController::PreArmCheck FlightController::preArmChecks[NUM_PREARM_CHECKS] =
+{
+	{"esc_init", &FlightController::checkESCs},
+	{"imu_init", &FlightController::checkIMUInit},
+	{"imu_who_am_i", &FlightController::checkIMUIdentity},
+	{"imu_sample_rate", &FlightController::checkIMUSampleRate},
+	{"imu_noise", &FlightController::checkIMUNoise},
+	{"imu_calibration", &FlightController::checkIMUCalibration}
+};
+
+FlightController::FlightController() : failsafe(escs, NUM_MOTORS)
+{
+	for(int i = 0; i < NUM_MOTORS; i++)
+		this->escs[i] = 0;
+
+	this->imu = 0;
+	this->currentThrottle = 0;
+	this->firstUpdateMs = 0;
+	this->lastUpdateMs = 0;
+	this->hasUpdated = false;
+	this->readyMs = 0;
+	this->reachedReady = false;
+	this->preArmStep = 0;
+	this->failedCheck = 0;
+	this->retryDelayMs = PREARM_RETRY_MIN_MS;
+	this->retryAtMs = 0;
+	this->retryPending = false;
+	this->checkStarted = false;
+	this->imuSamples = 0;
+	this->imuFresh = false;
+}
 
 FlightController::FlightController(int frontLeftMotorPin, int frontRightMotorPin, int backLeftMotorPin, int backRightMotorPin)
+	: FlightController()
+{
+	this->createESCs(frontLeftMotorPin, frontRightMotorPin, backLeftMotorPin, backRightMotorPin);
+}
+
+bool FlightController::setAccelerometer(Accelerometer * imu)
+{
+	if(imu != 0 && !imu->hasDriver())
+		return false;
+
+	this->imu = imu;
+	return true;
+}
+
+void FlightController::createESCs(int frontLeftMotorPin, int frontRightMotorPin, int backLeftMotorPin, int backRightMotorPin)
 {
 	this->escs[FRONT_LEFT_MOTOR] = new ESCControl(frontLeftMotorPin, MCPWM_UNIT_0, MCPWM_TIMER_0);
 	this->escs[FRONT_RIGHT_MOTOR] = new ESCControl(frontRightMotorPin, MCPWM_UNIT_0, MCPWM_TIMER_1);
@@ -32,44 +80,421 @@ FlightController::FlightController(int frontLeftMotorPin, int frontRightMotorPin
 
 bool FlightController::init()
 {
+	//Keep defaults when nothing has been saved yet
+	this->parameters.load();
+
+	if(this->escs[0] == 0)
+	{
+		this->createESCs(this->parameters.getInt(PARAM_FRONT_LEFT_MOTOR_PIN), this->parameters.getInt(PARAM_FRONT_RIGHT_MOTOR_PIN),
+			this->parameters.getInt(PARAM_BACK_LEFT_MOTOR_PIN), this->parameters.getInt(PARAM_BACK_RIGHT_MOTOR_PIN));
+	}
+
+	if(!this->configureESCs())
+		return false;
+
+	//ESCs that fail here are retried and reported by the esc_init pre-arm check
+	bool escsReady = true;
+
+	for(int i = 0; i < NUM_MOTORS; i++)
+		escsReady = this->escs[i]->init() && escsReady;
+
+	this->configureFailsafe();
+
+	if(!this->failsafe.begin())
+		return false;
+
+	this->handleEvent(EVENT_INIT_DONE, this->lastUpdateMs);
+	return escsReady;
+}
+
+bool FlightController::configureESCs()
+{
+	bool success = true;
+
+	//ESCs not created yet pick the parameters up when init() creates them
 	for(int i = 0; i < NUM_MOTORS; i++)
 	{
-		if(!this->escs[i]->init())
-			return false;
+		if(this->escs[i] == 0)
+			continue;
+
+		success = this->escs[i]->configure(this->parameters.getInt(PARAM_ESC_FREQUENCY_HZ), this->parameters.getFloat(PARAM_ESC_MIN_DUTY),
+			this->parameters.getFloat(PARAM_ESC_MAX_DUTY), this->parameters.getFloat(PARAM_ESC_THRUST_EXPO)) && success;
+	}
+
+	return success;
+}
+
+void FlightController::configureFailsafe()
+{
+	this->failsafe.setWatchdog(this->parameters.getInt(PARAM_FAILSAFE_PERIOD_US), this->parameters.getInt(PARAM_FAILSAFE_MISSED_TICKS));
+	this->failsafe.setLinkTimeouts(this->parameters.getInt(PARAM_FAILSAFE_HOLD_MS), this->parameters.getInt(PARAM_FAILSAFE_DESCEND_MS),
+		this->parameters.getInt(PARAM_FAILSAFE_DISARM_MS));
+	this->failsafe.setImuTimeout(this->parameters.getInt(PARAM_FAILSAFE_IMU_STALE_MS));
+}
+
+bool FlightController::applyParameters()
+{
+	if(!this->parameters.apply())
+		return true;
+
+	//Motor pins only take effect on the next boot
+	this->configureFailsafe();
+	return this->configureESCs();
+}
+
+FailsafeAction FlightController::update(uint32_t nowMs)
+{
+	if(!this->hasUpdated)
+	{
+		this->firstUpdateMs = nowMs;
+		this->lastUpdateMs = nowMs;
+		this->hasUpdated = true;
+	}
+
+	float elapsedS = (nowMs - this->lastUpdateMs) * .001f;
+	this->lastUpdateMs = nowMs;
+
+	this->failsafe.feed();
+	this->applyParameters();
+
+	//Only a new sample counts towards the sample rate and keeps the IMU from going stale
+	this->imuFresh = this->imu != 0 && this->imu->update();
+
+	if(this->imuFresh)
+	{
+		this->failsafe.onImuSample(nowMs);
+		this->imuSamples++;
+	}
+
+	if(this->retryPending && (int32_t)(nowMs - this->retryAtMs) >= 0)
+		this->retryPending = false;
+
+	if(this->modes.getMode() == MODE_CALIBRATING && !this->retryPending)
+		this->runPreArmStep(nowMs);
+
+	if(this->modes.getMode() != MODE_ARMED)
+		return FAILSAFE_NONE;
+
+	FailsafeAction action = this->failsafe.evaluate(nowMs);
+
+	switch(action)
+	{
+		case FAILSAFE_DESCEND:
+		{
+			float throttle = this->currentThrottle - this->parameters.getFloat(PARAM_FAILSAFE_DESCEND_RATE) * elapsedS;
+
+			//Disarm once the descent has wound the throttle all the way down
+			if(throttle > 0)
+			{
+				this->throttleAll(throttle);
+				break;
+			}
+		}
+		//fall through
+
+		case FAILSAFE_DISARM:
+			this->handleEvent(EVENT_FAILSAFE, nowMs);
+			action = FAILSAFE_DISARM;
+			break;
+
+		default:
+			break;
+	}
+
+	return action;
+}
+
+void FlightController::onCommand(uint32_t nowMs)
+{
+	this->failsafe.onCommand(nowMs);
+}
+
+Failsafe * FlightController::getFailsafe()
+{
+	return &this->failsafe;
+}
+
+ParameterStore * FlightController::getParameters()
+{
+	return &this->parameters;
+}
+
+bool FlightController::saveParameters()
+{
+	if(this->modes.getMode() == MODE_ARMED)
+		return false;
+
+	return this->parameters.save();
+}
+
+bool FlightController::handleEvent(FlightEvent event, uint32_t nowMs)
+{
+	if(!this->modes.dispatch(event, nowMs))
+		return false;
+
+	switch(this->modes.getMode())
+	{
+		case MODE_CALIBRATING:
+			this->preArmStep = 0;
+			this->checkStarted = false;
+
+			//Wait before retrying a failed check, but start at once when asked to
+			if(event == EVENT_CHECK_FAILED)
+			{
+				this->retryAtMs = nowMs + this->retryDelayMs;
+				this->retryPending = true;
+				this->retryDelayMs = this->retryDelayMs * 2 > PREARM_RETRY_MAX_MS ? PREARM_RETRY_MAX_MS : this->retryDelayMs * 2;
+			}
+			else
+			{
+				this->retryDelayMs = PREARM_RETRY_MIN_MS;
+				this->retryPending = false;
+			}
+			break;
+
+		case MODE_READY:
+			if(event == EVENT_DISARM)
+				this->stopMotors();
+			else
+			{
+				this->failedCheck = 0;
+				this->retryDelayMs = PREARM_RETRY_MIN_MS;
+
+				if(!this->reachedReady)
+				{
+					this->readyMs = nowMs;
+					this->reachedReady = true;
+				}
+			}
+			break;
+
+		case MODE_ARMED:
+			if(!this->startMotors())
+			{
+				this->handleEvent(EVENT_DISARM, nowMs);
+				return false;
+			}
+			break;
+
+		case MODE_FAILSAFE:
+			this->stopMotors();
+			break;
+
+		default:
+			break;
 	}
 
 	return true;
 }
 
-bool FlightController::arm()
+void FlightController::runPreArmStep(uint32_t nowMs)
+{
+	PreArmResult result = (this->*preArmChecks[this->preArmStep].run)();
+
+	if(result == PREARM_PENDING)
+		return;
+
+	this->checkStarted = false;
+
+	//A failed check restarts the pipeline from the beginning once the retry backoff has passed
+	if(result == PREARM_FAILED)
+	{
+		this->failedCheck = preArmChecks[this->preArmStep].name;
+		this->handleEvent(EVENT_CHECK_FAILED, nowMs);
+		return;
+	}
+
+	if(++this->preArmStep >= NUM_PREARM_CHECKS)
+		this->handleEvent(EVENT_CHECKS_PASSED, nowMs);
+}
+
+PreArmResult FlightController::checkESCs()
 {
+	bool ready = true;
+
 	for(int i = 0; i < NUM_MOTORS; i++)
 	{
-		if(!this->escs[i]->start())
-			return false;
+		if(this->escs[i] == 0)
+			return PREARM_FAILED;
+
+		if(!this->escs[i]->isInitialized())
+			ready = this->escs[i]->init() && ready;
 	}
 
-	return true;
+	return ready ? PREARM_PASSED : PREARM_FAILED;
 }
 
-bool FlightController::kill()
+PreArmResult FlightController::checkIMUInit()
+{
+	if(this->imu == 0)
+		return PREARM_PASSED;
+
+	return this->imu->init() ? PREARM_PASSED : PREARM_FAILED;
+}
+
+PreArmResult FlightController::checkIMUIdentity()
+{
+	if(this->imu == 0)
+		return PREARM_PASSED;
+
+	return this->imu->checkIdentity() ? PREARM_PASSED : PREARM_FAILED;
+}
+
+PreArmResult FlightController::checkIMUSampleRate()
+{
+	if(this->imu == 0)
+		return PREARM_PASSED;
+
+	if(!this->checkStarted)
+	{
+		this->checkStarted = true;
+		this->checkStartMs = this->lastUpdateMs;
+		this->checkStartSamples = this->imuSamples;
+		this->noiseSamples = 0;
+
+		for(int i = 0; i < 2; i++)
+		{
+			this->noiseSum[i] = 0;
+			this->noiseSumSquares[i] = 0;
+		}
+	}
+
+	//Gather the noise statistics over the same window so the noise check needs no window of its own
+	if(this->imuFresh)
+	{
+		float angles[2] = {this->imu->getPitch(), this->imu->getRoll()};
+
+		for(int i = 0; i < 2; i++)
+		{
+			this->noiseSum[i] += angles[i];
+			this->noiseSumSquares[i] += angles[i] * angles[i];
+		}
+
+		this->noiseSamples++;
+	}
+
+	uint32_t elapsedMs = this->lastUpdateMs - this->checkStartMs;
+
+	if(elapsedMs < (uint32_t)this->parameters.getInt(PARAM_PREARM_WINDOW_MS) || elapsedMs == 0)
+		return PREARM_PENDING;
+
+	uint32_t rateHz = (this->imuSamples - this->checkStartSamples) * 1000 / elapsedMs;
+	return rateHz >= (uint32_t)this->parameters.getInt(PARAM_PREARM_MIN_IMU_RATE_HZ) ? PREARM_PASSED : PREARM_FAILED;
+}
+
+PreArmResult FlightController::checkIMUNoise()
+{
+	if(this->imu == 0)
+		return PREARM_PASSED;
+
+	if(this->noiseSamples == 0)
+		return PREARM_FAILED;
+
+	//Pitch and roll variance while sitting still, in degrees squared
+	for(int i = 0; i < 2; i++)
+	{
+		float mean = this->noiseSum[i] / this->noiseSamples;
+		float variance = this->noiseSumSquares[i] / this->noiseSamples - mean * mean;
+
+		if(variance > this->parameters.getFloat(PARAM_PREARM_MAX_IMU_NOISE))
+			return PREARM_FAILED;
+	}
+
+	return PREARM_PASSED;
+}
+
+PreArmResult FlightController::checkIMUCalibration()
+{
+	if(this->imu == 0)
+		return PREARM_PASSED;
+
+	this->imu->callibrate();
+	return PREARM_PASSED;
+}
+
+bool FlightController::startMotors()
 {
 	for(int i = 0; i < NUM_MOTORS; i++)
 	{
-		if(!this->escs[i]->stop())
+		if(this->escs[i] == 0 || !this->escs[i]->start())
+		{
+			this->stopMotors();
 			return false;
+		}
 	}
 
+	this->currentThrottle = 0;
+	this->failsafe.enable();
 	return true;
 }
 
+bool FlightController::stopMotors()
+{
+	bool success = true;
+
+	this->failsafe.disable();
+
+	//Never stop early, and fall back to forcing the output low if a motor will not stop
+	for(int i = 0; i < NUM_MOTORS; i++)
+	{
+		if(this->escs[i] != 0 && !this->escs[i]->stop() && !this->escs[i]->forceOff())
+			success = false;
+	}
+
+	return success;
+}
+
+bool FlightController::arm()
+{
+	return this->handleEvent(EVENT_ARM, this->lastUpdateMs);
+}
+
+bool FlightController::kill()
+{
+	//Cut the motors whatever the mode, then leave ARMED if needed
+	bool success = this->stopMotors();
+
+	if(this->modes.getMode() == MODE_ARMED)
+		this->modes.dispatch(EVENT_DISARM, this->lastUpdateMs);
+
+	return success;
+}
+
+bool FlightController::calibrate()
+{
+	FlightEvent event = this->modes.getMode() == MODE_FAILSAFE ? EVENT_RECOVER : EVENT_CALIBRATE;
+	return this->handleEvent(event, this->lastUpdateMs);
+}
+
+FlightMode FlightController::getMode()
+{
+	return this->modes.getMode();
+}
+
+const char * FlightController::getFailedCheck()
+{
+	return this->failedCheck;
+}
+
+uint32_t FlightController::getBootToReadyMs()
+{
+	return this->reachedReady ? this->readyMs - this->firstUpdateMs : 0;
+}
+
 bool FlightController::throttleAll(float speed)
 {
+	FC_PROFILE_SCOPE(PROBE_THROTTLE_ALL);
+
+	//The motors are only started while armed
+	if(this->modes.getMode() != MODE_ARMED)
+		return false;
+
 	for(uint8_t i = 0; i < NUM_MOTORS; i++)
 	{
-		if(!this->escs[i]->setRPMPercentage(speed))
+		if(this->escs[i] == 0 || !this->escs[i]->setThrustPercentage(speed))
 			return false;
 	}
 
+	this->currentThrottle = speed;
 	return true;
 }
\ No newline at end of file
@@ -24,6 +24,10 @@
 #define FLIGHTCONTROLLER_H
 
 #include "ESCControl.h"
+#include "ParameterStore.h"
+#include "Failsafe.h"
+#include "FlightMode.h"
+#include "Accelerometer.h"
 
 #define NUM_MOTORS 4
 #define FRONT_LEFT_MOTOR 0
@@ -31,12 +35,144 @@
 #define BACK_LEFT_MOTOR 2
 #define BACK_RIGHT_MOTOR 3
 
+#define NUM_PREARM_CHECKS 6
+
+//Wait before rerunning failed pre-arm checks, doubling after each failure until they pass
+#define PREARM_RETRY_MIN_MS 100
+#define PREARM_RETRY_MAX_MS 5000
+
+/**
+ * @brief Progress of a single pre-arm check
+ */
+typedef enum
+{
+	PREARM_PENDING = 0,
+	PREARM_PASSED,
+	PREARM_FAILED
+} PreArmResult;
+
 class FlightController
 {
 protected:
 	ESCControl * escs[NUM_MOTORS];
 
+	//Runtime tunables, loaded from storage on init
+	ParameterStore parameters;
+
+	//Loop watchdog and link loss handling for the ESCs
+	Failsafe failsafe;
+
+	//INIT, CALIBRATING, READY, ARMED and FAILSAFE mode handling
+	FlightStateMachine modes;
+
+	//The attached sensor, 0 when flying without one
+	Accelerometer * imu;
+
+	//The last thrust percentage commanded while armed
+	float currentThrottle;
+
+	//The time of the first and the previous control tick in milliseconds
+	uint32_t firstUpdateMs;
+	uint32_t lastUpdateMs;
+	bool hasUpdated;
+
+	//The time READY was first reached, for measuring boot to ready
+	uint32_t readyMs;
+	bool reachedReady;
+
+	/**
+	 * @brief A step of the pre-arm pipeline, called once per control tick until it passes or fails
+	 */
+	typedef struct
+	{
+		const char * name;
+		PreArmResult (FlightController::*run)();
+	} PreArmCheck;
+
+	static const PreArmCheck preArmChecks[NUM_PREARM_CHECKS];
+
+	//The check being run, and the name of the last one to fail or 0
+	uint8_t preArmStep;
+	const char * failedCheck;
+
+	//Backoff before the checks rerun after a failure, so a missing sensor is not hammered every tick
+	uint32_t retryDelayMs;
+	uint32_t retryAtMs;
+	bool retryPending;
+
+	//State for checks that observe the IMU over a window of ticks
+	bool checkStarted;
+	uint32_t checkStartMs;
+	uint32_t checkStartSamples;
+	uint32_t imuSamples;
+	bool imuFresh;
+	uint32_t noiseSamples;
+	float noiseSum[2];
+	float noiseSumSquares[2];
+
+	/**
+	 * @brief Create the ESC objects for each motor pin
+	 */
+	void createESCs(int frontLeftMotorPin, int frontRightMotorPin, int backLeftMotorPin, int backRightMotorPin);
+
+	/**
+	 * @brief Push the active ESC parameters to every ESC
+	 * 
+	 * @return
+	 * 		- true all ESCs reconfigured
+	 * 		- false at least one ESC failed to reconfigure
+	 */
+	bool configureESCs();
+
+	/**
+	 * @brief Push the active failsafe parameters to the failsafe
+	 */
+	void configureFailsafe();
+
+	/**
+	 * @brief Apply an event to the mode state machine and run the entry action of the new mode
+	 * 
+	 * @param event The event to apply
+	 * @param nowMs The current time in milliseconds
+	 * 
+	 * @return
+	 * 		- true the new mode was entered
+	 * 		- false the event is not allowed in the current mode or the entry action failed
+	 */
+	bool handleEvent(FlightEvent event, uint32_t nowMs);
+
+	/**
+	 * @brief Start every ESC at zero throttle and enable the watchdog, stopping them all if any fails
+	 */
+	bool startMotors();
+
+	/**
+	 * @brief Disable the watchdog and stop every ESC, forcing outputs low when a stop fails
+	 */
+	bool stopMotors();
+
+	/**
+	 * @brief Advance the pre-arm pipeline by one step
+	 * 
+	 * @param nowMs The current time in milliseconds
+	 */
+	void runPreArmStep(uint32_t nowMs);
+
+	//Pre-arm checks in the order they run, the IMU checks pass when no accelerometer is attached
+	//Checks that observe a window time it from lastUpdateMs
+	PreArmResult checkESCs();
+	PreArmResult checkIMUInit();
+	PreArmResult checkIMUIdentity();
+	PreArmResult checkIMUSampleRate();
+	PreArmResult checkIMUNoise();
+	PreArmResult checkIMUCalibration();
+
 public:
+	/**
+	 * @brief Prepare a flight controller that takes its motor pins from the stored parameters during init
+	 */
+	FlightController();
+
 	/**
 	 * @brief Initialize the ESCs and the accelerometer objects
 	 * 
@@ -48,7 +184,20 @@ public:
 	FlightController(int frontLeftMotorPin, int frontRightMotorPin, int backLeftMotorPin, int backRightMotorPin);
 
 	/**
-	 * @brief Initialize ESC PWM connections and start the I2C accelerometer connection
+	 * @brief Attach the sensor to check before arming and to read every control tick, call before init
+	 * 
+	 * @param imu The accelerometer to use, constructed with a driver
+	 * 
+	 * @return
+	 * 		- true sensor attached
+	 * 		- false the accelerometer has no driver and could never pass the checks
+	 */
+	bool setAccelerometer(Accelerometer * imu);
+
+	/**
+	 * @brief Load stored parameters, initialize ESC PWM connections and start calibrating
+	 * 
+	 * The accelerometer is started by the pre-arm checks run from update.
 	 * 
 	 * @return
 	 *     - true Successful start
@@ -57,7 +206,61 @@ public:
 	bool init();
 
 	/**
-	 * @brief Arm the motors
+	 * @brief Run the per-tick housekeeping: feed the watchdog, apply parameter changes, read the IMU,
+	 * advance the pre-arm checks and act on any failsafe
+	 * 
+	 * @param nowMs The current time in milliseconds
+	 * 
+	 * @return The failsafe action in effect, after descending or disarming as required
+	 */
+	FailsafeAction update(uint32_t nowMs);
+
+	/**
+	 * @brief Record that a command arrived over the control link, resetting link loss handling
+	 * 
+	 * @param nowMs The current time in milliseconds
+	 */
+	void onCommand(uint32_t nowMs);
+
+	/**
+	 * @brief Get the failsafe for IMU freshness reports and cutoff latency measurements
+	 * 
+	 * @return The flight controller's failsafe
+	 */
+	Failsafe * getFailsafe();
+
+	/**
+	 * @brief Activate committed parameter changes, call between control ticks
+	 * 
+	 * @return
+	 * 		- true parameters are up to date
+	 * 		- false new parameters were applied but an ESC failed to reconfigure
+	 */
+	bool applyParameters();
+
+	/**
+	 * @brief Get the parameter store for reading, editing and saving tunables
+	 * 
+	 * @return The flight controller's parameter store
+	 */
+	ParameterStore * getParameters();
+
+	/**
+	 * @brief Save the active parameters to storage, refused while armed
+	 * 
+	 * Writing NVS suspends the flash cache and the other core, stalling the control loop while the motors run.
+	 * 
+	 * @return
+	 * 		- true parameters saved
+	 * 		- false armed or storage unavailable
+	 */
+	bool saveParameters();
+
+	/**
+	 * @brief Arm the motors at zero throttle and start the loop watchdog, only allowed once the pre-arm checks pass
+	 * 
+	 * Once armed, update() must be called every control tick. The watchdog forces every motor off when
+	 * failsafe_missed_ticks periods of failsafe_period_us pass without one, 15ms with the default parameters.
 	 * 
 	 * @return
 	 * 		- true Successful arming
@@ -66,7 +269,7 @@ public:
 	bool arm();
 
 	/**
-	 * @brief Kill motor movement
+	 * @brief Kill motor movement in any mode, attempting every motor even if some fail, safe to call before init
 	 * 
 	 * @return
 	 * 		- true all motors killed
@@ -75,13 +278,43 @@ public:
 	bool kill();
 
 	/**
-	 * @brief Throttle all motors on the aircraft to a certain percentage
+	 * @brief Rerun the pre-arm checks, from READY or to leave FAILSAFE
+	 * 
+	 * @return
+	 * 		- true calibration started
+	 * 		- false not allowed in the current mode
+	 */
+	bool calibrate();
+
+	/**
+	 * @brief Get the current flight mode
+	 * 
+	 * @return The current mode
+	 */
+	FlightMode getMode();
+
+	/**
+	 * @brief Get the name of the pre-arm check that failed most recently since the checks last passed
+	 * 
+	 * @return The check name, or 0 if none has failed
+	 */
+	const char * getFailedCheck();
+
+	/**
+	 * @brief Get the time from the first control tick until the pre-arm checks first passed
+	 * 
+	 * @return The boot to ready time in milliseconds, or 0 if not ready yet
+	 */
+	uint32_t getBootToReadyMs();
+
+	/**
+	 * @brief Throttle all motors on the aircraft to a certain percentage of full thrust
 	 * 
-	 * @param speed The throttle percentage of the motors
+	 * @param speed The thrust percentage of the motors
 	 * 
 	 * @return
 	 * 		- true Speed change success
-	 * 		- false Speed change failure
+	 * 		- false Speed change failure, or the flight controller is not armed
 	 */
 	bool throttleAll(float speed);
 
@@ -0,0 +1,86 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "FlightMode.h"
+
+//Marks an event that is ignored in a mode
+#define NO_TRANSITION NUM_FLIGHT_MODES
+
+static const uint8_t transitions[NUM_FLIGHT_MODES][NUM_FLIGHT_EVENTS] =
+{
+	//INIT_DONE, CHECKS_PASSED, CHECK_FAILED, CALIBRATE, ARM, DISARM, FAILSAFE, RECOVER
+	{MODE_CALIBRATING, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION},
+	{NO_TRANSITION, MODE_READY, MODE_CALIBRATING, MODE_CALIBRATING, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION},
+	{NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, MODE_CALIBRATING, MODE_ARMED, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION},
+	{NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, MODE_READY, MODE_FAILSAFE, NO_TRANSITION},
+	{NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, NO_TRANSITION, MODE_CALIBRATING}
+};
+
+static const char * modeNames[NUM_FLIGHT_MODES] =
+{
+	"INIT",
+	"CALIBRATING",
+	"READY",
+	"ARMED",
+	"FAILSAFE"
+};
+
+FlightStateMachine::FlightStateMachine()
+{
+	this->mode = MODE_INIT;
+
+	for(int i = 0; i < NUM_FLIGHT_MODES; i++)
+		this->enteredMs[i] = 0;
+}
+
+bool FlightStateMachine::getTransition(FlightEvent event, FlightMode * next) const
+{
+	uint8_t target = transitions[this->mode][event];
+
+	if(target == NO_TRANSITION)
+		return false;
+
+	*next = (FlightMode)target;
+	return true;
+}
+
+bool FlightStateMachine::dispatch(FlightEvent event, uint32_t nowMs)
+{
+	FlightMode next;
+
+	if(!this->getTransition(event, &next))
+		return false;
+
+	this->mode = next;
+	this->enteredMs[next] = nowMs;
+	return true;
+}
+
+uint32_t FlightStateMachine::getEnteredMs(FlightMode mode) const
+{
+	return this->enteredMs[mode];
+}
+
+const char * FlightStateMachine::getModeName(FlightMode mode)
+{
+	return modeNames[mode];
+}
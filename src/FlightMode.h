@@ -0,0 +1,126 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef FLIGHTMODE_H
+#define FLIGHTMODE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Flight controller modes
+ */
+typedef enum
+{
+	MODE_INIT = 0,
+	MODE_CALIBRATING,
+	MODE_READY,
+	MODE_ARMED,
+	MODE_FAILSAFE,
+	NUM_FLIGHT_MODES
+} FlightMode;
+
+/**
+ * @brief Events that can move the flight controller between modes
+ */
+typedef enum
+{
+	EVENT_INIT_DONE = 0,
+	EVENT_CHECKS_PASSED,
+	EVENT_CHECK_FAILED,
+	EVENT_CALIBRATE,
+	EVENT_ARM,
+	EVENT_DISARM,
+	EVENT_FAILSAFE,
+	EVENT_RECOVER,
+	NUM_FLIGHT_EVENTS
+} FlightEvent;
+
+/**
+ * @brief Table driven flight mode state machine
+ *
+ * Each mode and event pair maps to the next mode, or to no transition when the event is not allowed in that mode.
+ */
+class FlightStateMachine
+{
+protected:
+	FlightMode mode;
+
+	//Time each mode was last entered in milliseconds
+	uint32_t enteredMs[NUM_FLIGHT_MODES];
+
+public:
+	FlightStateMachine();
+
+	/**
+	 * @brief Look up the mode an event leads to without changing modes
+	 *
+	 * @param event The event to look up
+	 * @param next Set to the mode the event leads to
+	 *
+	 * @return
+	 * 		- true the event is allowed in the current mode
+	 * 		- false the event is ignored in the current mode
+	 */
+	bool getTransition(FlightEvent event, FlightMode * next) const;
+
+	/**
+	 * @brief Apply an event, entering the next mode if it is allowed
+	 *
+	 * @param event The event to apply
+	 * @param nowMs The current time in milliseconds
+	 *
+	 * @return
+	 * 		- true the mode was entered, possibly the same mode again
+	 * 		- false the event is ignored in the current mode
+	 */
+	bool dispatch(FlightEvent event, uint32_t nowMs);
+
+	/**
+	 * @brief Get the current mode
+	 *
+	 * @return The current mode
+	 */
+	inline FlightMode getMode() const
+	{
+		return this->mode;
+	}
+
+	/**
+	 * @brief Get when a mode was last entered
+	 *
+	 * @param mode The mode to look up
+	 *
+	 * @return The time the mode was entered in milliseconds
+	 */
+	uint32_t getEnteredMs(FlightMode mode) const;
+
+	/**
+	 * @brief Get the printable name of a mode
+	 *
+	 * @param mode The mode to look up
+	 *
+	 * @return The name of the mode
+	 */
+	static const char * getModeName(FlightMode mode);
+};
+
+#endif
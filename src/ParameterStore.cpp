@@ -0,0 +1,410 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "ParameterStore.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP32
+#include <nvs.h>
+#else
+#include <stdio.h>
+#endif
+
+typedef struct
+{
+	const char * name;
+	ParameterType type;
+	float defaultValue;
+	float minValue;
+	float maxValue;
+} ParameterInfo;
+
+#define FC_PARAMETER_INFO(id, name, type, defaultValue, minValue, maxValue) {name, type, (float)(defaultValue), (float)(minValue), (float)(maxValue)},
+
+static const ParameterInfo parameterInfo[NUM_PARAMETERS] =
+{
+	FC_PARAMETER_LIST(FC_PARAMETER_INFO)
+};
+
+#undef FC_PARAMETER_INFO
+
+static const char * const resultNames[] =
+{
+	"ok",
+	"wrong type",
+	"not a number",
+	"out of range",
+	"conflicts with another parameter"
+};
+
+//Range check that also rejects NaN
+static bool inRange(ParameterId id, float value)
+{
+	return value >= parameterInfo[id].minValue && value <= parameterInfo[id].maxValue;
+}
+
+static bool inRange(ParameterId id, const ParameterValue & value)
+{
+	if(parameterInfo[id].type == PARAM_TYPE_INT)
+		return inRange(id, (float)value.i);
+
+	return inRange(id, value.f);
+}
+
+//Accept trailing whitespace such as a line ending, but nothing else after the number
+static bool parsedToEnd(const char * text, const char * end)
+{
+	if(end == text)
+		return false;
+
+	while(*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+		end++;
+
+	return *end == 0;
+}
+
+static void writeUint32(uint8_t * buffer, uint32_t value)
+{
+	buffer[0] = value;
+	buffer[1] = value >> 8;
+	buffer[2] = value >> 16;
+	buffer[3] = value >> 24;
+}
+
+static uint32_t readUint32(const uint8_t * buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+//FNV-1a hash over the value section of a blob
+static uint32_t checksum(const uint8_t * data, uint32_t size)
+{
+	uint32_t hash = 2166136261u;
+
+	for(uint32_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+ParameterStore::ParameterStore()
+{
+#ifdef ESP32
+	portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+	this->stagingLock = unlocked;
+#endif
+
+	for(int i = 0; i < NUM_PARAMETERS; i++)
+	{
+		if(parameterInfo[i].type == PARAM_TYPE_INT)
+			this->staged[i].i = (int32_t)parameterInfo[i].defaultValue;
+		else
+			this->staged[i].f = parameterInfo[i].defaultValue;
+	}
+
+	memcpy(this->banks[0], this->staged, sizeof(this->staged));
+	memcpy(this->banks[1], this->staged, sizeof(this->staged));
+	this->activeBank = 0;
+	this->pendingApply = false;
+}
+
+void ParameterStore::lockStaging()
+{
+#ifdef ESP32
+	portENTER_CRITICAL(&this->stagingLock);
+#endif
+}
+
+void ParameterStore::unlockStaging()
+{
+#ifdef ESP32
+	portEXIT_CRITICAL(&this->stagingLock);
+#endif
+}
+
+ParameterResult ParameterStore::checkConsistency(const ParameterValue * values)
+{
+	//An empty or inverted duty range gives no throttle or inverts it
+	if(!(values[PARAM_ESC_MIN_DUTY].f < values[PARAM_ESC_MAX_DUTY].f))
+		return PARAM_INCONSISTENT;
+
+	return PARAM_OK;
+}
+
+ParameterResult ParameterStore::setInt(ParameterId id, int32_t value)
+{
+	if(parameterInfo[id].type != PARAM_TYPE_INT)
+		return PARAM_WRONG_TYPE;
+
+	if(!inRange(id, (float)value))
+		return PARAM_OUT_OF_RANGE;
+
+	this->lockStaging();
+	this->staged[id].i = value;
+	this->unlockStaging();
+	return PARAM_OK;
+}
+
+ParameterResult ParameterStore::setFloat(ParameterId id, float value)
+{
+	if(parameterInfo[id].type != PARAM_TYPE_FLOAT)
+		return PARAM_WRONG_TYPE;
+
+	if(!inRange(id, value))
+		return PARAM_OUT_OF_RANGE;
+
+	this->lockStaging();
+	this->staged[id].f = value;
+	this->unlockStaging();
+	return PARAM_OK;
+}
+
+ParameterResult ParameterStore::setFromString(ParameterId id, const char * text)
+{
+	char * end;
+
+	if(parameterInfo[id].type == PARAM_TYPE_INT)
+	{
+		long value = strtol(text, &end, 0);
+
+		if(!parsedToEnd(text, end))
+			return PARAM_INVALID_VALUE;
+
+		//Check before narrowing so huge values cannot wrap into range
+		if(!inRange(id, (float)value))
+			return PARAM_OUT_OF_RANGE;
+
+		return this->setInt(id, (int32_t)value);
+	}
+
+	float value = strtof(text, &end);
+
+	if(!parsedToEnd(text, end))
+		return PARAM_INVALID_VALUE;
+
+	return this->setFloat(id, value);
+}
+
+ParameterResult ParameterStore::commit()
+{
+	this->lockStaging();
+	ParameterResult result = checkConsistency(this->staged);
+
+	if(result == PARAM_OK)
+		this->commitStaged();
+
+	this->unlockStaging();
+	return result;
+}
+
+void ParameterStore::commitStaged()
+{
+	//Later edits only change the staging table, so apply() swaps in exactly the values checked here
+	memcpy(this->banks[!this->activeBank], this->staged, sizeof(this->staged));
+	this->pendingApply = true;
+}
+
+bool ParameterStore::apply()
+{
+	if(!this->pendingApply)
+		return false;
+
+	this->lockStaging();
+	this->activeBank = !this->activeBank;
+	this->pendingApply = false;
+	this->unlockStaging();
+
+	return true;
+}
+
+bool ParameterStore::find(const char * name, ParameterId * id) const
+{
+	for(int i = 0; i < NUM_PARAMETERS; i++)
+	{
+		if(strcmp(parameterInfo[i].name, name) == 0)
+		{
+			*id = (ParameterId)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char * ParameterStore::getName(ParameterId id) const
+{
+	return parameterInfo[id].name;
+}
+
+ParameterType ParameterStore::getType(ParameterId id) const
+{
+	return parameterInfo[id].type;
+}
+
+float ParameterStore::getMin(ParameterId id) const
+{
+	return parameterInfo[id].minValue;
+}
+
+float ParameterStore::getMax(ParameterId id) const
+{
+	return parameterInfo[id].maxValue;
+}
+
+const char * ParameterStore::getResultName(ParameterResult result)
+{
+	return resultNames[result];
+}
+
+uint32_t ParameterStore::serialize(uint8_t * buffer, uint32_t bufferSize) const
+{
+	if(bufferSize < PARAMETER_BLOB_MAX_SIZE)
+		return 0;
+
+	//Header is magic, version (16 bits), count (16 bits) and checksum, followed by little endian values
+	uint8_t * values = buffer + PARAMETER_BLOB_HEADER_SIZE;
+	const ParameterValue * active = this->banks[this->activeBank];
+
+	for(int i = 0; i < NUM_PARAMETERS; i++)
+	{
+		uint32_t raw;
+		memcpy(&raw, &active[i], sizeof(raw));
+		writeUint32(values + i * 4, raw);
+	}
+
+	writeUint32(buffer, PARAMETER_BLOB_MAGIC);
+	writeUint32(buffer + 4, PARAMETER_BLOB_VERSION | (NUM_PARAMETERS << 16));
+	writeUint32(buffer + 8, checksum(values, NUM_PARAMETERS * 4));
+
+	return PARAMETER_BLOB_MAX_SIZE;
+}
+
+bool ParameterStore::deserialize(const uint8_t * buffer, uint32_t size)
+{
+	if(size < PARAMETER_BLOB_HEADER_SIZE || readUint32(buffer) != PARAMETER_BLOB_MAGIC)
+		return false;
+
+	uint32_t versionAndCount = readUint32(buffer + 4);
+	uint32_t count = versionAndCount >> 16;
+	const uint8_t * values = buffer + PARAMETER_BLOB_HEADER_SIZE;
+
+	if((versionAndCount & 0xffff) != PARAMETER_BLOB_VERSION || size < PARAMETER_BLOB_HEADER_SIZE + count * 4)
+		return false;
+
+	if(readUint32(buffer + 8) != checksum(values, count * 4))
+		return false;
+
+	//Blobs from older builds have fewer parameters, the newer ones keep their staged values
+	if(count > NUM_PARAMETERS)
+		count = NUM_PARAMETERS;
+
+	this->lockStaging();
+
+	//Check the whole blob before touching the staged values, so a bad blob changes nothing
+	ParameterValue loaded[NUM_PARAMETERS];
+	memcpy(loaded, this->staged, sizeof(loaded));
+
+	bool valid = true;
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uint32_t raw = readUint32(values + i * 4);
+		memcpy(&loaded[i], &raw, sizeof(raw));
+		valid = valid && inRange((ParameterId)i, loaded[i]);
+	}
+
+	valid = valid && checkConsistency(loaded) == PARAM_OK;
+
+	if(valid)
+	{
+		memcpy(this->staged, loaded, sizeof(loaded));
+		this->commitStaged();
+	}
+
+	this->unlockStaging();
+	return valid;
+}
+
+bool ParameterStore::save() const
+{
+	uint8_t blob[PARAMETER_BLOB_MAX_SIZE];
+	uint32_t size = this->serialize(blob, sizeof(blob));
+
+#ifdef ESP32
+	nvs_handle handle;
+
+	if(nvs_open(PARAMETER_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+		return false;
+
+	bool saved = nvs_set_blob(handle, PARAMETER_NVS_KEY, blob, size) == ESP_OK && nvs_commit(handle) == ESP_OK;
+	nvs_close(handle);
+	return saved;
+#else
+	FILE * file = fopen(PARAMETER_FILE_PATH, "wb");
+
+	if(file == NULL)
+		return false;
+
+	bool saved = fwrite(blob, 1, size, file) == size;
+	return (fclose(file) == 0) && saved;
+#endif
+}
+
+bool ParameterStore::load()
+{
+	uint8_t blob[PARAMETER_BLOB_LOAD_SIZE];
+	uint32_t size;
+
+#ifdef ESP32
+	nvs_handle handle;
+	size_t blobSize = sizeof(blob);
+
+	if(nvs_open(PARAMETER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+		return false;
+
+	bool found = nvs_get_blob(handle, PARAMETER_NVS_KEY, blob, &blobSize) == ESP_OK;
+	nvs_close(handle);
+
+	if(!found)
+		return false;
+
+	size = blobSize;
+#else
+	FILE * file = fopen(PARAMETER_FILE_PATH, "rb");
+
+	if(file == NULL)
+		return false;
+
+	size = fread(blob, 1, sizeof(blob), file);
+	fclose(file);
+#endif
+
+	if(!this->deserialize(blob, size))
+		return false;
+
+	this->apply();
+	return true;
+}
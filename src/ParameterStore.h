@@ -0,0 +1,286 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef PARAMETERSTORE_H
+#define PARAMETERSTORE_H
+
+#include <stdint.h>
+#include "Parameters.h"
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#endif
+
+#define PARAMETER_BLOB_MAGIC 0x52504346
+//Version 2 dropped the unused mpu6050_addr parameter, shifting every later position
+#define PARAMETER_BLOB_VERSION 2
+#define PARAMETER_BLOB_HEADER_SIZE 12
+#define PARAMETER_BLOB_MAX_SIZE (PARAMETER_BLOB_HEADER_SIZE + NUM_PARAMETERS * 4)
+
+//Leaves room for blobs saved by newer builds with extra parameters
+#define PARAMETER_BLOB_LOAD_SIZE (PARAMETER_BLOB_MAX_SIZE + 64 * 4)
+
+#define PARAMETER_NVS_NAMESPACE "flightctl"
+#define PARAMETER_NVS_KEY "params"
+#define PARAMETER_FILE_PATH "flightctl_params.bin"
+
+/**
+ * @brief A single parameter value, interpreted according to its ParameterType
+ */
+typedef union
+{
+	int32_t i;
+	float f;
+} ParameterValue;
+
+/**
+ * @brief Registry of runtime tunables with double-buffered updates
+ *
+ * The control loop reads from the active table. Changes are written to a staging table from any task,
+ * then commit() checks them and copies them to the inactive table, and the control loop swaps the tables
+ * with apply() between ticks. Edits made after a commit wait for the next commit.
+ */
+class ParameterStore
+{
+protected:
+	//Active and inactive value tables, the control loop only reads from banks[activeBank]
+	ParameterValue banks[2][NUM_PARAMETERS];
+	uint8_t activeBank;
+
+	//Values being edited, copied to the inactive bank by a successful commit
+	ParameterValue staged[NUM_PARAMETERS];
+
+	//Set when staged changes are ready to be applied
+	volatile bool pendingApply;
+
+#ifdef ESP32
+	//Guards the staging table between the editing task and the control loop
+	portMUX_TYPE stagingLock;
+#endif
+
+	void lockStaging();
+	void unlockStaging();
+
+	/**
+	 * @brief Copy the checked staging table to the inactive bank and mark it ready, call with the lock held
+	 */
+	void commitStaged();
+
+	/**
+	 * @brief Check rules that span several parameters, such as the ESC duty range
+	 *
+	 * @param values A full table of values to check
+	 *
+	 * @return
+	 * 		- PARAM_OK the values work together
+	 * 		- PARAM_INCONSISTENT the values conflict
+	 */
+	static ParameterResult checkConsistency(const ParameterValue * values);
+
+public:
+	/**
+	 * @brief Initialize every parameter to its default value
+	 */
+	ParameterStore();
+
+	/**
+	 * @brief Get the active value of an integer parameter
+	 *
+	 * @param id The parameter to read
+	 *
+	 * @return The active value
+	 */
+	inline int32_t getInt(ParameterId id) const
+	{
+		return this->banks[this->activeBank][id].i;
+	}
+
+	/**
+	 * @brief Get the active value of a float parameter
+	 *
+	 * @param id The parameter to read
+	 *
+	 * @return The active value
+	 */
+	inline float getFloat(ParameterId id) const
+	{
+		return this->banks[this->activeBank][id].f;
+	}
+
+	/**
+	 * @brief Stage a new value for an integer parameter, taking effect after commit() and apply()
+	 *
+	 * @param id The parameter to change
+	 * @param value The new value
+	 *
+	 * @return
+	 * 		- PARAM_OK value staged
+	 * 		- PARAM_WRONG_TYPE the parameter is not an integer
+	 * 		- PARAM_OUT_OF_RANGE the value is outside the parameter's range, nothing staged
+	 */
+	ParameterResult setInt(ParameterId id, int32_t value);
+
+	/**
+	 * @brief Stage a new value for a float parameter, taking effect after commit() and apply()
+	 *
+	 * @param id The parameter to change
+	 * @param value The new value
+	 *
+	 * @return
+	 * 		- PARAM_OK value staged
+	 * 		- PARAM_WRONG_TYPE the parameter is not a float
+	 * 		- PARAM_OUT_OF_RANGE the value is outside the parameter's range or not a number, nothing staged
+	 */
+	ParameterResult setFloat(ParameterId id, float value);
+
+	/**
+	 * @brief Stage a value given as text, converting it to the parameter's type
+	 *
+	 * @param id The parameter to change
+	 * @param text The new value as a decimal number, or a 0x prefixed hex number for integers
+	 *
+	 * @return
+	 * 		- PARAM_OK value staged
+	 * 		- PARAM_INVALID_VALUE the text is not a number of the parameter's type, nothing staged
+	 * 		- PARAM_OUT_OF_RANGE the value is outside the parameter's range, nothing staged
+	 */
+	ParameterResult setFromString(ParameterId id, const char * text);
+
+	/**
+	 * @brief Mark all staged changes as ready to be applied, if they work together
+	 *
+	 * @return
+	 * 		- PARAM_OK changes committed
+	 * 		- PARAM_INCONSISTENT staged values conflict, such as a min duty at or above the max duty, nothing committed
+	 */
+	ParameterResult commit();
+
+	/**
+	 * @brief Swap committed changes into the active table, call from the control loop between ticks
+	 *
+	 * @return
+	 * 		- true new values are active
+	 * 		- false nothing was committed
+	 */
+	bool apply();
+
+	/**
+	 * @brief Look up a parameter by name
+	 *
+	 * @param name The name of the parameter
+	 * @param id Set to the parameter's id when found
+	 *
+	 * @return
+	 * 		- true parameter found
+	 * 		- false no parameter has this name
+	 */
+	bool find(const char * name, ParameterId * id) const;
+
+	/**
+	 * @brief Get the name of a parameter
+	 *
+	 * @param id The parameter to look up
+	 *
+	 * @return The name of the parameter
+	 */
+	const char * getName(ParameterId id) const;
+
+	/**
+	 * @brief Get the storage type of a parameter
+	 *
+	 * @param id The parameter to look up
+	 *
+	 * @return The type of the parameter
+	 */
+	ParameterType getType(ParameterId id) const;
+
+	/**
+	 * @brief Get the smallest value a parameter accepts
+	 *
+	 * @param id The parameter to look up
+	 *
+	 * @return The minimum value
+	 */
+	float getMin(ParameterId id) const;
+
+	/**
+	 * @brief Get the largest value a parameter accepts
+	 *
+	 * @param id The parameter to look up
+	 *
+	 * @return The maximum value
+	 */
+	float getMax(ParameterId id) const;
+
+	/**
+	 * @brief Get a short description of a result for reporting back to the user
+	 *
+	 * @param result The result to describe
+	 *
+	 * @return The description
+	 */
+	static const char * getResultName(ParameterResult result);
+
+	/**
+	 * @brief Write the active values to a binary blob
+	 *
+	 * @param buffer The buffer to write to
+	 * @param bufferSize The size of the buffer, at least PARAMETER_BLOB_MAX_SIZE
+	 *
+	 * @return The number of bytes written, 0 if the buffer is too small
+	 */
+	uint32_t serialize(uint8_t * buffer, uint32_t bufferSize) const;
+
+	/**
+	 * @brief Stage and commit the values in a binary blob
+	 *
+	 * @param buffer The blob written by serialize
+	 * @param size The size of the blob
+	 *
+	 * @return
+	 * 		- true values staged and committed
+	 * 		- false the blob is corrupt, from an incompatible version or holds out of range values
+	 */
+	bool deserialize(const uint8_t * buffer, uint32_t size);
+
+	/**
+	 * @brief Save the active values to NVS on the ESP32 or to PARAMETER_FILE_PATH elsewhere
+	 *
+	 * Only save while the motors are stopped, FlightController::saveParameters() enforces this.
+	 *
+	 * @return
+	 * 		- true values saved
+	 * 		- false storage unavailable
+	 */
+	bool save() const;
+
+	/**
+	 * @brief Load saved values from NVS on the ESP32 or from PARAMETER_FILE_PATH elsewhere, applying them immediately
+	 *
+	 * @return
+	 * 		- true saved values loaded
+	 * 		- false nothing saved or saved values invalid, defaults kept
+	 */
+	bool load();
+};
+
+#endif
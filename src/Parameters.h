@@ -0,0 +1,111 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef PARAMETERS_H
+#define PARAMETERS_H
+
+//ESC output defaults
+#define ESC_DEFAULT_FREQUENCY_HZ 50
+#define ESC_DEFAULT_MIN_DUTY 5
+#define ESC_DEFAULT_MAX_DUTY 10
+#define ESC_DEFAULT_THRUST_EXPO 1.0
+
+//Motor pins on the Adafruit ESP32 Feather
+#define MOTOR_DEFAULT_FRONT_LEFT_PIN 33
+#define MOTOR_DEFAULT_FRONT_RIGHT_PIN 15
+#define MOTOR_DEFAULT_BACK_LEFT_PIN 32
+#define MOTOR_DEFAULT_BACK_RIGHT_PIN 14
+
+//Loop watchdog and link loss defaults
+#define FAILSAFE_DEFAULT_PERIOD_US 5000
+#define FAILSAFE_DEFAULT_MISSED_TICKS 3
+#define FAILSAFE_DEFAULT_HOLD_MS 250
+#define FAILSAFE_DEFAULT_DESCEND_MS 1000
+#define FAILSAFE_DEFAULT_DISARM_MS 10000
+#define FAILSAFE_DEFAULT_IMU_STALE_MS 50
+#define FAILSAFE_DEFAULT_DESCEND_RATE 10
+
+//Pre-arm check defaults
+#define PREARM_DEFAULT_WINDOW_MS 500
+#define PREARM_DEFAULT_MIN_IMU_RATE_HZ 100
+#define PREARM_DEFAULT_MAX_IMU_NOISE .05
+
+/*
+ * Every runtime tunable as PARAM(id, name, type, default, min, max), with values outside min to max rejected.
+ * Stored blobs are matched by position, so only ever add new parameters at the end of the list.
+ * Removing or reordering a parameter needs a PARAMETER_BLOB_VERSION bump so older blobs are ignored.
+ */
+#define FC_PARAMETER_LIST(PARAM) \
+	PARAM(PARAM_ESC_FREQUENCY_HZ, "esc_frequency_hz", PARAM_TYPE_INT, ESC_DEFAULT_FREQUENCY_HZ, 50, 500) \
+	PARAM(PARAM_ESC_MIN_DUTY, "esc_min_duty", PARAM_TYPE_FLOAT, ESC_DEFAULT_MIN_DUTY, .5, 99) \
+	PARAM(PARAM_ESC_MAX_DUTY, "esc_max_duty", PARAM_TYPE_FLOAT, ESC_DEFAULT_MAX_DUTY, .5, 99) \
+	PARAM(PARAM_ESC_THRUST_EXPO, "esc_thrust_expo", PARAM_TYPE_FLOAT, ESC_DEFAULT_THRUST_EXPO, 0, 1) \
+	PARAM(PARAM_FRONT_LEFT_MOTOR_PIN, "front_left_motor_pin", PARAM_TYPE_INT, MOTOR_DEFAULT_FRONT_LEFT_PIN, 0, 39) \
+	PARAM(PARAM_FRONT_RIGHT_MOTOR_PIN, "front_right_motor_pin", PARAM_TYPE_INT, MOTOR_DEFAULT_FRONT_RIGHT_PIN, 0, 39) \
+	PARAM(PARAM_BACK_LEFT_MOTOR_PIN, "back_left_motor_pin", PARAM_TYPE_INT, MOTOR_DEFAULT_BACK_LEFT_PIN, 0, 39) \
+	PARAM(PARAM_BACK_RIGHT_MOTOR_PIN, "back_right_motor_pin", PARAM_TYPE_INT, MOTOR_DEFAULT_BACK_RIGHT_PIN, 0, 39) \
+	PARAM(PARAM_FAILSAFE_PERIOD_US, "failsafe_period_us", PARAM_TYPE_INT, FAILSAFE_DEFAULT_PERIOD_US, 1000, 100000) \
+	PARAM(PARAM_FAILSAFE_MISSED_TICKS, "failsafe_missed_ticks", PARAM_TYPE_INT, FAILSAFE_DEFAULT_MISSED_TICKS, 1, 100) \
+	PARAM(PARAM_FAILSAFE_HOLD_MS, "failsafe_hold_ms", PARAM_TYPE_INT, FAILSAFE_DEFAULT_HOLD_MS, 0, 600000) \
+	PARAM(PARAM_FAILSAFE_DESCEND_MS, "failsafe_descend_ms", PARAM_TYPE_INT, FAILSAFE_DEFAULT_DESCEND_MS, 0, 600000) \
+	PARAM(PARAM_FAILSAFE_DISARM_MS, "failsafe_disarm_ms", PARAM_TYPE_INT, FAILSAFE_DEFAULT_DISARM_MS, 0, 600000) \
+	PARAM(PARAM_FAILSAFE_IMU_STALE_MS, "failsafe_imu_stale_ms", PARAM_TYPE_INT, FAILSAFE_DEFAULT_IMU_STALE_MS, 0, 10000) \
+	PARAM(PARAM_FAILSAFE_DESCEND_RATE, "failsafe_descend_rate", PARAM_TYPE_FLOAT, FAILSAFE_DEFAULT_DESCEND_RATE, .1, 100) \
+	PARAM(PARAM_PREARM_WINDOW_MS, "prearm_window_ms", PARAM_TYPE_INT, PREARM_DEFAULT_WINDOW_MS, 10, 10000) \
+	PARAM(PARAM_PREARM_MIN_IMU_RATE_HZ, "prearm_min_imu_rate_hz", PARAM_TYPE_INT, PREARM_DEFAULT_MIN_IMU_RATE_HZ, 1, 8000) \
+	PARAM(PARAM_PREARM_MAX_IMU_NOISE, "prearm_max_imu_noise", PARAM_TYPE_FLOAT, PREARM_DEFAULT_MAX_IMU_NOISE, 0, 100)
+
+#define FC_PARAMETER_ID(id, name, type, defaultValue, minValue, maxValue) id,
+
+/**
+ * @brief Index of each parameter in the parameter table, generated from FC_PARAMETER_LIST
+ */
+typedef enum
+{
+	FC_PARAMETER_LIST(FC_PARAMETER_ID)
+	NUM_PARAMETERS
+} ParameterId;
+
+#undef FC_PARAMETER_ID
+
+/**
+ * @brief Storage type of a parameter
+ */
+typedef enum
+{
+	PARAM_TYPE_INT = 0,
+	PARAM_TYPE_FLOAT
+} ParameterType;
+
+/**
+ * @brief Outcome of staging or committing a parameter change
+ */
+typedef enum
+{
+	PARAM_OK = 0,
+	PARAM_WRONG_TYPE,
+	PARAM_INVALID_VALUE,
+	PARAM_OUT_OF_RANGE,
+	PARAM_INCONSISTENT
+} ParameterResult;
+
+#endif
@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "Profiler.h"
+
+#ifdef FC_PROFILING
+
+#include <string.h>
+#include <stdio.h>
+
+#define PROFILER_LINE_LENGTH 320
+
+ProfileHistogram Profiler::histograms[NUM_PROFILE_PROBES];
+
+static const char * probeNames[NUM_PROFILE_PROBES] =
+{
+	"accel_update",
+	"esc_set_rpm",
+	"esc_set_thrust",
+	"throttle_all"
+};
+
+const ProfileHistogram * Profiler::getHistogram(ProfileProbe probe)
+{
+	return &histograms[probe];
+}
+
+const char * Profiler::getProbeName(ProfileProbe probe)
+{
+	return probeNames[probe];
+}
+
+void Profiler::reset()
+{
+	memset(histograms, 0, sizeof(histograms));
+}
+
+void Profiler::formatProbe(ProfileProbe probe, char * buffer, int bufferSize)
+{
+	const ProfileHistogram * histogram = &histograms[probe];
+	uint32_t mean = histogram->count ? (uint32_t)(histogram->totalCycles / histogram->count) : 0;
+
+	int length = snprintf(buffer, bufferSize, "%s count=%u min=%u mean=%u max=%u hist=", probeNames[probe],
+		(unsigned)histogram->count, (unsigned)histogram->minCycles, (unsigned)mean, (unsigned)histogram->maxCycles);
+
+	for(int i = 0; i < PROFILER_HISTOGRAM_BUCKETS && length < bufferSize; i++)
+		length += snprintf(buffer + length, bufferSize - length, i ? ",%u" : "%u", (unsigned)histogram->buckets[i]);
+}
+
+#ifdef ARDUINO
+void Profiler::dump(Print & out)
+{
+	char line[PROFILER_LINE_LENGTH];
+
+	for(int i = 0; i < NUM_PROFILE_PROBES; i++)
+	{
+		formatProbe((ProfileProbe)i, line, sizeof(line));
+		out.println(line);
+	}
+}
+#else
+void Profiler::dump(FILE * out)
+{
+	char line[PROFILER_LINE_LENGTH];
+
+	for(int i = 0; i < NUM_PROFILE_PROBES; i++)
+	{
+		formatProbe((ProfileProbe)i, line, sizeof(line));
+		fprintf(out, "%s\n", line);
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * Hot path probes are only compiled in when FC_PROFILING is defined (build_flags = -D FC_PROFILING).
+ * Otherwise FC_PROFILE_SCOPE expands to nothing and the profiler does not exist.
+ */
+#ifdef FC_PROFILING
+
+#include <stdint.h>
+#include "CycleCounter.h"
+
+#ifdef ARDUINO
+#include <Print.h>
+#else
+#include <stdio.h>
+#endif
+
+//Bucket n counts samples taking 2^n to 2^(n+1) - 1 cycles, the last bucket also counts anything longer
+#define PROFILER_HISTOGRAM_BUCKETS 24
+
+/**
+ * @brief Instrumented sections of the library
+ */
+typedef enum
+{
+	PROBE_ACCEL_UPDATE = 0,
+	PROBE_ESC_SET_RPM,
+	PROBE_ESC_SET_THRUST,
+	PROBE_THROTTLE_ALL,
+	NUM_PROFILE_PROBES
+} ProfileProbe;
+
+/**
+ * @brief Timing statistics collected for a single probe
+ */
+typedef struct
+{
+	uint32_t count;
+	uint32_t minCycles;
+	uint32_t maxCycles;
+	uint64_t totalCycles;
+	uint32_t buckets[PROFILER_HISTOGRAM_BUCKETS];
+} ProfileHistogram;
+
+class Profiler
+{
+protected:
+	static ProfileHistogram histograms[NUM_PROFILE_PROBES];
+
+	/**
+	 * @brief Format the statistics of one probe as a single line of text
+	 *
+	 * @param probe The probe to format
+	 * @param buffer The buffer to write the line to
+	 * @param bufferSize The size of the buffer
+	 */
+	static void formatProbe(ProfileProbe probe, char * buffer, int bufferSize);
+
+public:
+	/**
+	 * @brief Add a timing sample to a probe's histogram
+	 *
+	 * @param probe The probe being timed
+	 * @param cycles The number of cycles the section took
+	 */
+	static void record(ProfileProbe probe, uint32_t cycles)
+	{
+		ProfileHistogram * histogram = &histograms[probe];
+		int bucket = 31 - __builtin_clz(cycles | 1);
+
+		if(bucket >= PROFILER_HISTOGRAM_BUCKETS)
+			bucket = PROFILER_HISTOGRAM_BUCKETS - 1;
+
+		if(histogram->count == 0 || cycles < histogram->minCycles)
+			histogram->minCycles = cycles;
+
+		if(cycles > histogram->maxCycles)
+			histogram->maxCycles = cycles;
+
+		histogram->count++;
+		histogram->totalCycles += cycles;
+		histogram->buckets[bucket]++;
+	}
+
+	/**
+	 * @brief Get the statistics collected for a probe
+	 *
+	 * @param probe The probe to look up
+	 *
+	 * @return The probe's histogram
+	 */
+	static const ProfileHistogram * getHistogram(ProfileProbe probe);
+
+	/**
+	 * @brief Get the printable name of a probe
+	 *
+	 * @param probe The probe to look up
+	 *
+	 * @return The name of the probe
+	 */
+	static const char * getProbeName(ProfileProbe probe);
+
+	/**
+	 * @brief Clear all collected statistics
+	 */
+	static void reset();
+
+#ifdef ARDUINO
+	/**
+	 * @brief Print every probe's statistics and histogram, one probe per line
+	 *
+	 * @param out The output to print to, such as Serial
+	 */
+	static void dump(Print & out);
+#else
+	/**
+	 * @brief Print every probe's statistics and histogram, one probe per line
+	 *
+	 * @param out The file to print to, such as stdout
+	 */
+	static void dump(FILE * out);
+#endif
+};
+
+/**
+ * @brief Times the enclosing scope and records it to a probe when the scope exits
+ */
+class ProfileScope
+{
+protected:
+	ProfileProbe probe;
+	uint32_t startCycles;
+
+public:
+	ProfileScope(ProfileProbe probe)
+	{
+		this->probe = probe;
+		this->startCycles = readCycleCounter();
+	}
+
+	~ProfileScope()
+	{
+		Profiler::record(this->probe, readCycleCounter() - this->startCycles);
+	}
+};
+
+#define FC_PROFILE_SCOPE(probe) ProfileScope profileScope(probe)
+
+#else
+
+#define FC_PROFILE_SCOPE(probe)
+
+#endif
+
+#endif
@@ -0,0 +1,346 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "Telemetry.h"
+#include <string.h>
+
+//Zig-zag maps small negative and positive deltas to small unsigned values
+static inline uint32_t zigZag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline uint8_t varintLength(uint32_t value)
+{
+	uint8_t length = 1;
+
+	while(value >= 0x80)
+	{
+		value >>= 7;
+		length++;
+	}
+
+	return length;
+}
+
+static uint8_t crc8(const uint8_t * data, uint8_t length)
+{
+	uint8_t crc = 0;
+
+	for(uint8_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+
+		for(uint8_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+
+	return crc;
+}
+
+TelemetryScheduler::TelemetryScheduler()
+{
+	this->numFields = 0;
+	this->nextSequence = 0;
+	this->ackedSequence = 0;
+	this->hasAck = false;
+	this->rateScale = 256;
+
+	this->windowStartMs = 0;
+	this->windowBytes = 0;
+	this->bytesPerSecond = 0;
+	this->windowCongested = false;
+	this->linkBudget = 0;
+	this->maxLinkBudget = 0;
+
+	memset(this->values, 0, sizeof(this->values));
+	memset(this->ackedValues, 0, sizeof(this->ackedValues));
+	memset(this->historyValid, 0, sizeof(this->historyValid));
+}
+
+int TelemetryScheduler::addField(uint16_t rateHz, uint8_t priority)
+{
+	if(this->numFields >= TELEMETRY_MAX_FIELDS)
+		return -1;
+
+	if(rateHz == 0)
+		rateHz = 1;
+
+	uint8_t field = this->numFields++;
+
+	this->priorities[field] = priority;
+	this->periodsMs[field] = 1000 / rateHz;
+	this->nextDueMs[field] = 0;
+	this->values[field] = 0;
+
+	return field;
+}
+
+void TelemetryScheduler::acknowledge(uint8_t sequence)
+{
+	uint8_t slot = sequence & (TELEMETRY_HISTORY - 1);
+
+	if(!this->historyValid[slot] || this->historySequence[slot] != sequence)
+		return;
+
+	//Ignore acknowledgements older than the current reference
+	if(this->hasAck && (int8_t)(sequence - this->ackedSequence) <= 0)
+		return;
+
+	memcpy(this->ackedValues, this->history[slot], sizeof(this->ackedValues));
+	this->ackedSequence = sequence;
+	this->hasAck = true;
+}
+
+bool TelemetryScheduler::isDue(uint32_t nowMs)
+{
+	for(uint8_t field = 0; field < this->numFields; field++)
+	{
+		if((int32_t)(nowMs - this->nextDueMs[field]) >= 0)
+			return true;
+	}
+
+	return false;
+}
+
+void TelemetryScheduler::setLinkBudget(uint32_t bytesPerSecond)
+{
+	this->linkBudget = bytesPerSecond;
+	this->maxLinkBudget = bytesPerSecond;
+}
+
+void TelemetryScheduler::onCongestion(uint32_t nowMs)
+{
+	this->windowCongested = true;
+	this->updateWindow(nowMs);
+}
+
+void TelemetryScheduler::updateWindow(uint32_t nowMs)
+{
+	uint32_t elapsedMs = nowMs - this->windowStartMs;
+
+	if(elapsedMs < TELEMETRY_WINDOW_MS)
+		return;
+
+	this->bytesPerSecond = this->windowBytes * 1000 / elapsedMs;
+
+	//Refused frames mean the link carries less than the budget, take what got through with some headroom
+	if(this->windowCongested)
+	{
+		uint32_t carried = this->bytesPerSecond * 7 / 8;
+
+		if(this->linkBudget == 0 || carried < this->linkBudget)
+			this->linkBudget = carried < TELEMETRY_MIN_BUDGET ? TELEMETRY_MIN_BUDGET : carried;
+	}
+	else if(this->linkBudget != 0 && (this->maxLinkBudget == 0 || this->linkBudget < this->maxLinkBudget) &&
+		this->bytesPerSecond >= this->linkBudget * 7 / 8)
+	{
+		//Only probe for more once the link carried close to the budget without trouble
+		this->linkBudget += this->linkBudget / 32 + 1;
+
+		if(this->maxLinkBudget != 0 && this->linkBudget > this->maxLinkBudget)
+			this->linkBudget = this->maxLinkBudget;
+	}
+
+	//Scale the rates by how far over budget the link ran, otherwise recover towards full rate
+	if(this->linkBudget != 0 && this->bytesPerSecond > this->linkBudget)
+	{
+		uint32_t scale = this->rateScale * this->linkBudget / this->bytesPerSecond;
+		this->rateScale = scale < TELEMETRY_MIN_RATE_SCALE ? TELEMETRY_MIN_RATE_SCALE : scale;
+	}
+	else if(!this->windowCongested && this->rateScale < 256)
+	{
+		//Close half the gap to the budget each window so the rates settle instead of overshooting
+		uint32_t step = 16;
+
+		if(this->linkBudget != 0 && this->bytesPerSecond != 0)
+		{
+			uint32_t target = this->rateScale * this->linkBudget / this->bytesPerSecond;
+			step = target > this->rateScale ? (target - this->rateScale + 1) / 2 : 0;
+
+			if(step > 16)
+				step = 16;
+		}
+
+		this->rateScale += step;
+
+		if(this->rateScale > 256)
+			this->rateScale = 256;
+	}
+
+	this->windowStartMs = nowMs;
+	this->windowBytes = 0;
+	this->windowCongested = false;
+}
+
+uint32_t TelemetryScheduler::getPeriod(uint8_t field)
+{
+	if(this->priorities[field] >= TELEMETRY_CRITICAL_PRIORITY)
+		return this->periodsMs[field];
+
+	return (this->periodsMs[field] << 8) / this->rateScale;
+}
+
+uint8_t TelemetryScheduler::buildFrame(uint32_t nowMs, uint8_t * frame)
+{
+	uint8_t due[TELEMETRY_MAX_FIELDS];
+	uint8_t numDue = 0;
+	uint8_t numEarly = 0;
+
+	//Collect due fields ordered by priority, then by how long they have been waiting
+	for(uint8_t field = 0; field < this->numFields; field++)
+	{
+		if((int32_t)(nowMs - this->nextDueMs[field]) < 0)
+			continue;
+
+		uint8_t position = numDue++;
+
+		while(position > 0)
+		{
+			uint8_t previous = due[position - 1];
+
+			if(this->priorities[previous] > this->priorities[field] || (this->priorities[previous] == this->priorities[field] &&
+				(int32_t)(this->nextDueMs[previous] - this->nextDueMs[field]) <= 0))
+				break;
+
+			due[position] = previous;
+			position--;
+		}
+
+		due[position] = field;
+	}
+
+	if(numDue == 0)
+		return 0;
+
+	//Fill spare room with fields due within half a period, rather than sending them in a frame of their own soon after
+	for(uint8_t field = 0; field < this->numFields; field++)
+	{
+		int32_t untilDueMs = (int32_t)(this->nextDueMs[field] - nowMs);
+
+		if(untilDueMs > 0 && (uint32_t)untilDueMs <= this->getPeriod(field) / 2)
+			due[numDue + numEarly++] = field;
+	}
+
+	//Drop a reference the receiver no longer holds before the sequence can wrap around onto it
+	uint8_t sequence = this->nextSequence++;
+
+	if(this->hasAck && (uint8_t)(sequence - this->ackedSequence) >= TELEMETRY_HISTORY)
+		this->hasAck = false;
+
+	uint8_t slot = sequence & (TELEMETRY_HISTORY - 1);
+	int32_t * snapshot = this->history[slot];
+
+	//Fall back to deltas from zero while there is no reference the receiver still holds
+	bool useReference = this->hasAck;
+
+	if(useReference)
+		memcpy(snapshot, this->ackedValues, sizeof(this->ackedValues));
+	else
+		memset(snapshot, 0, sizeof(this->ackedValues));
+
+	uint8_t length = TELEMETRY_HEADER_SIZE;
+	uint8_t count = 0;
+
+	for(uint8_t i = 0; i < numDue + numEarly; i++)
+	{
+		uint8_t field = due[i];
+		uint32_t encoded = zigZag((int32_t)((uint32_t)this->values[field] - (uint32_t)snapshot[field]));
+
+		//Leave fields that do not fit due for the next frame
+		if(length + 1 + varintLength(encoded) > TELEMETRY_FRAME_SIZE - 1)
+			continue;
+
+		frame[length++] = field;
+
+		while(encoded >= 0x80)
+		{
+			frame[length++] = (encoded & 0x7f) | 0x80;
+			encoded >>= 7;
+		}
+
+		frame[length++] = encoded;
+
+		snapshot[field] = this->values[field];
+		count++;
+
+		//Keep a steady cadence, so fields sent early are not sent more often, but skip periods that were missed entirely
+		uint32_t period = this->getPeriod(field);
+		this->nextDueMs[field] += period;
+
+		if((int32_t)(nowMs - this->nextDueMs[field]) >= 0)
+			this->nextDueMs[field] = nowMs + period;
+	}
+
+	memset(frame + length, 0, TELEMETRY_FRAME_SIZE - 1 - length);
+
+	frame[0] = TELEMETRY_SYNC_BYTE;
+	frame[1] = sequence;
+	frame[2] = useReference ? this->ackedSequence : sequence;
+	frame[3] = count;
+	frame[TELEMETRY_FRAME_SIZE - 1] = crc8(frame, TELEMETRY_FRAME_SIZE - 1);
+
+	this->historySequence[slot] = sequence;
+	this->historyValid[slot] = true;
+
+	this->updateWindow(nowMs);
+	this->windowBytes += TELEMETRY_FRAME_SIZE;
+	return TELEMETRY_FRAME_SIZE;
+}
+
+#ifdef ARDUINO
+bool TelemetryScheduler::service(HardwareSerial & port, uint32_t nowMs)
+{
+	if(!this->isDue(nowMs))
+		return false;
+
+	//A frame that does not fit in the transmit buffer would block the control loop
+	if(port.availableForWrite() < TELEMETRY_FRAME_SIZE)
+	{
+		this->onCongestion(nowMs);
+		return false;
+	}
+
+	uint8_t frame[TELEMETRY_FRAME_SIZE];
+
+	if(this->buildFrame(nowMs, frame) == 0)
+		return false;
+
+	port.write(frame, TELEMETRY_FRAME_SIZE);
+	return true;
+}
+#endif
+
+uint32_t TelemetryScheduler::getBytesPerSecond()
+{
+	return this->bytesPerSecond;
+}
+
+uint32_t TelemetryScheduler::getLinkBudget()
+{
+	return this->linkBudget;
+}
+
+uint16_t TelemetryScheduler::getRateScale()
+{
+	return this->rateScale;
+}
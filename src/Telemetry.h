@@ -0,0 +1,226 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <HardwareSerial.h>
+#endif
+
+#define TELEMETRY_MAX_FIELDS 16
+#define TELEMETRY_FRAME_SIZE 32
+#define TELEMETRY_HEADER_SIZE 4
+#define TELEMETRY_SYNC_BYTE 0xa5
+
+//Number of sent frames remembered for acknowledgement, a power of 2
+#define TELEMETRY_HISTORY 8
+
+//Fields at or above this priority keep their full rate when the link is congested
+#define TELEMETRY_CRITICAL_PRIORITY 200
+
+//Slowest rate scale applied to non-critical fields under congestion, as a fraction of 256
+#define TELEMETRY_MIN_RATE_SCALE 16
+
+//Length of each throughput measurement, after which rates are adjusted
+#define TELEMETRY_WINDOW_MS 250
+
+//Lowest link budget learned from congestion, enough for a frame every 100ms
+#define TELEMETRY_MIN_BUDGET (TELEMETRY_FRAME_SIZE * 10)
+
+/**
+ * @brief Schedules flight state fields over a bandwidth limited link
+ *
+ * Each field has its own rate and priority. Due fields are packed highest priority first into fixed size frames:
+ * sync byte, sequence, reference sequence and field count, then for each field its index and the zig-zag varint
+ * of its change since the reference frame, zero padding and a CRC-8 of everything before it. Room left over is
+ * filled with fields due within half a period, keeping their cadence.
+ *
+ * The reference is the newest frame the receiver acknowledged, so the receiver decodes against its own copy of
+ * that frame and must keep copies of its last TELEMETRY_HISTORY frames. A reference equal to the frame's own
+ * sequence means the deltas are from zero, which is sent once the acknowledged frame is older than that history.
+ * Values in a frame's copy that were not sent in it are carried over from its reference.
+ *
+ * Non-critical rates follow the measured throughput: after each TELEMETRY_WINDOW_MS window, a throughput above the
+ * link budget scales them down in proportion, and one within budget lets them recover halfway towards it.
+ * A window in which the link refused a frame lowers the budget to 7/8 of what actually got through. The budget
+ * grows back by 1/32 per clean window that used most of it, up to the limit given to setLinkBudget.
+ */
+class TelemetryScheduler
+{
+protected:
+	uint8_t numFields;
+	uint8_t priorities[TELEMETRY_MAX_FIELDS];
+	uint32_t periodsMs[TELEMETRY_MAX_FIELDS];
+	uint32_t nextDueMs[TELEMETRY_MAX_FIELDS];
+	int32_t values[TELEMETRY_MAX_FIELDS];
+
+	//Field values as the receiver knows them after each recently sent frame
+	int32_t history[TELEMETRY_HISTORY][TELEMETRY_MAX_FIELDS];
+	uint8_t historySequence[TELEMETRY_HISTORY];
+	bool historyValid[TELEMETRY_HISTORY];
+
+	//Field values as of the newest acknowledged frame
+	int32_t ackedValues[TELEMETRY_MAX_FIELDS];
+
+	uint8_t nextSequence;
+	uint8_t ackedSequence;
+	bool hasAck;
+
+	//Rate multiplier for non-critical fields out of 256, lowered when the link cannot keep up
+	uint16_t rateScale;
+
+	//Throughput measured over the last whole window
+	uint32_t windowStartMs;
+	uint32_t windowBytes;
+	uint32_t bytesPerSecond;
+
+	//Set when the link refused a frame during the current window
+	bool windowCongested;
+
+	//Bytes per second the link is believed to carry, and the most it may grow to, 0 for no limit
+	uint32_t linkBudget;
+	uint32_t maxLinkBudget;
+
+	/**
+	 * @brief Get the time between sends of a field, slowed by the rate scale unless it is critical
+	 *
+	 * @param field The field index
+	 *
+	 * @return The period in milliseconds
+	 */
+	uint32_t getPeriod(uint8_t field);
+
+	/**
+	 * @brief Close the throughput window once it has run its length and adjust the budget and rates
+	 *
+	 * @param nowMs The current time in milliseconds
+	 */
+	void updateWindow(uint32_t nowMs);
+
+public:
+	TelemetryScheduler();
+
+	/**
+	 * @brief Check whether any field is due to be sent
+	 *
+	 * @param nowMs The current time in milliseconds
+	 *
+	 * @return
+	 * 		- true at least one field is due
+	 * 		- false nothing to send yet
+	 */
+	bool isDue(uint32_t nowMs);
+
+	/**
+	 * @brief Register a field to send
+	 *
+	 * @param rateHz How often to send the field
+	 * @param priority Fields with higher priority are packed first and critical ones are never slowed down
+	 *
+	 * @return The field index used for setValue and on the wire, or -1 if TELEMETRY_MAX_FIELDS are already registered
+	 */
+	int addField(uint16_t rateHz, uint8_t priority);
+
+	/**
+	 * @brief Update the latest value of a field, in the field's fixed point units
+	 *
+	 * @param field The field index returned by addField
+	 * @param value The new value
+	 */
+	inline void setValue(uint8_t field, int32_t value)
+	{
+		this->values[field] = value;
+	}
+
+	/**
+	 * @brief Record that the receiver decoded a frame, making it the reference for later deltas
+	 *
+	 * @param sequence The sequence number of the decoded frame
+	 */
+	void acknowledge(uint8_t sequence);
+
+	/**
+	 * @brief Set the throughput the link can carry, leaving headroom below its raw rate
+	 *
+	 * Without a budget, one is learned the first time the link refuses a frame.
+	 *
+	 * @param bytesPerSecond The usable link throughput in bytes per second, 0 for none
+	 */
+	void setLinkBudget(uint32_t bytesPerSecond);
+
+	/**
+	 * @brief Record that the link could not take a due frame, lowering the budget at the end of the window
+	 *
+	 * @param nowMs The current time in milliseconds
+	 */
+	void onCongestion(uint32_t nowMs);
+
+	/**
+	 * @brief Pack every field that is due into a frame
+	 *
+	 * @param nowMs The current time in milliseconds
+	 * @param frame Buffer of TELEMETRY_FRAME_SIZE bytes to write the frame to
+	 *
+	 * @return TELEMETRY_FRAME_SIZE if a frame was built, 0 if no fields are due
+	 */
+	uint8_t buildFrame(uint32_t nowMs, uint8_t * frame);
+
+#ifdef ARDUINO
+	/**
+	 * @brief Send a frame if fields are due and the UART transmit buffer has room, never blocking
+	 *
+	 * @param port The serial port to send on
+	 * @param nowMs The current time in milliseconds
+	 *
+	 * @return
+	 * 		- true frame sent
+	 * 		- false nothing due or the link is congested
+	 */
+	bool service(HardwareSerial & port, uint32_t nowMs);
+#endif
+
+	/**
+	 * @brief Get the frame throughput measured over the last whole window
+	 *
+	 * @return The measured throughput in bytes per second
+	 */
+	uint32_t getBytesPerSecond();
+
+	/**
+	 * @brief Get the throughput the rates are currently adapted to
+	 *
+	 * @return The link budget in bytes per second, 0 if none has been set or learned
+	 */
+	uint32_t getLinkBudget();
+
+	/**
+	 * @brief Get the current rate multiplier for non-critical fields
+	 *
+	 * @return The rate scale out of 256
+	 */
+	uint16_t getRateScale();
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "ThrottleCurve.h"
+#include <math.h>
+
+ThrottleCurve::ThrottleCurve(float frequency, float minDuty, float maxDuty, float thrustExpo)
+{
+	this->minPulseWidth = 0;
+	this->maxPulseWidth = 0;
+	this->thrustExpo = -1;
+	this->configure(frequency, minDuty, maxDuty, thrustExpo);
+}
+
+void ThrottleCurve::configure(float frequency, float minDuty, float maxDuty, float thrustExpo)
+{
+	//Convert duty percentages to pulse widths in microseconds
+	float minPulseWidth = minDuty * 10000.0f / frequency;
+	float maxPulseWidth = maxDuty * 10000.0f / frequency;
+
+	if(thrustExpo > 1)
+		thrustExpo = 1.0;
+	else if(thrustExpo < 0)
+		thrustExpo = 0.0;
+
+	bool rangeChanged = minPulseWidth != this->minPulseWidth || maxPulseWidth != this->maxPulseWidth;
+	bool expoChanged = thrustExpo != this->thrustExpo;
+
+	if(!rangeChanged && !expoChanged)
+		return;
+
+	this->minPulseWidth = minPulseWidth;
+	this->maxPulseWidth = maxPulseWidth;
+
+	if(expoChanged)
+	{
+		this->thrustExpo = thrustExpo;
+
+		//Invert thrust = (1 - expo) * c + expo * c^2 for each thrust step
+		for(int i = 0; i <= THROTTLE_CURVE_SEGMENTS; i++)
+		{
+			float thrust = (float)i / THROTTLE_CURVE_SEGMENTS;
+
+			if(thrustExpo < .001f)
+				this->commands[i] = thrust;
+			else
+			{
+				float linear = 1.0f - thrustExpo;
+				this->commands[i] = (sqrtf(linear * linear + 4.0f * thrustExpo * thrust) - linear) / (2.0f * thrustExpo);
+			}
+		}
+	}
+
+	this->fillTable();
+}
+
+bool ThrottleCurve::setMeasuredCurve(const float * thrust, uint8_t numPoints)
+{
+	if(numPoints < 2 || numPoints > THROTTLE_CURVE_MAX_MEASURED_POINTS)
+		return false;
+
+	//Comparisons with NaN are always false, so check every measurement explicitly
+	for(uint8_t i = 0; i < numPoints; i++)
+	{
+		if(!isfinite(thrust[i]))
+			return false;
+	}
+
+	float range = thrust[numPoints - 1] - thrust[0];
+
+	if(range <= 0)
+		return false;
+
+	//Normalize measurements to 0 - 1 and reject curves that decrease anywhere
+	float normalized[THROTTLE_CURVE_MAX_MEASURED_POINTS];
+
+	for(uint8_t i = 0; i < numPoints; i++)
+	{
+		normalized[i] = (thrust[i] - thrust[0]) / range;
+
+		if(i > 0 && normalized[i] < normalized[i - 1])
+			return false;
+	}
+
+	//Walk the measured curve once, finding the command that produces each thrust step
+	uint8_t segment = 0;
+
+	for(int i = 0; i <= THROTTLE_CURVE_SEGMENTS; i++)
+	{
+		float target = (float)i / THROTTLE_CURVE_SEGMENTS;
+
+		while(segment < numPoints - 2 && normalized[segment + 1] < target)
+			segment++;
+
+		float segmentThrust = normalized[segment + 1] - normalized[segment];
+		float fraction = 1.0f;
+
+		if(segmentThrust > 0)
+			fraction = (target - normalized[segment]) / segmentThrust;
+
+		if(fraction < 0)
+			fraction = 0.0;
+		else if(fraction > 1)
+			fraction = 1.0;
+
+		this->commands[i] = (segment + fraction) / (numPoints - 1);
+	}
+
+	this->fillTable();
+	return true;
+}
+
+void ThrottleCurve::fillTable()
+{
+	float pulseRange = this->maxPulseWidth - this->minPulseWidth;
+
+	for(int i = 0; i <= THROTTLE_CURVE_SEGMENTS; i++)
+		this->pulseTable[i] = (uint16_t)(this->minPulseWidth + this->commands[i] * pulseRange + .5f);
+}
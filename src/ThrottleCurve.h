@@ -0,0 +1,118 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef THROTTLECURVE_H
+#define THROTTLECURVE_H
+
+#include <stdint.h>
+
+#define THROTTLE_CURVE_SEGMENTS 64
+#define THROTTLE_CURVE_MAX_MEASURED_POINTS 32
+
+/**
+ * @brief Precomputed lookup table mapping a thrust percentage to an ESC pulse width
+ *
+ * Thrust is modelled as (1 - expo) * c + expo * c^2 where c is the normalized command between min and max duty.
+ * The table holds the inverse of that curve so a thrust request becomes one indexed load and a linear interpolation.
+ */
+class ThrottleCurve
+{
+protected:
+	//Pulse widths in microseconds for thrust 0% to 100% in THROTTLE_CURVE_SEGMENTS equal steps
+	uint16_t pulseTable[THROTTLE_CURVE_SEGMENTS + 1];
+
+	//Normalized commands (0 to 1) for each thrust step, from the model or a measured curve
+	float commands[THROTTLE_CURVE_SEGMENTS + 1];
+
+	//Pulse widths at the minimum and maximum duty cycle
+	float minPulseWidth;
+	float maxPulseWidth;
+
+	//The modelled expo the commands were built from, or below 0 before the first configure
+	float thrustExpo;
+
+	/**
+	 * @brief Fill the pulse table by scaling the normalized commands to the pulse width range
+	 */
+	void fillTable();
+
+public:
+	/**
+	 * @brief Build the lookup table for a given duty range and thrust curve
+	 *
+	 * @param frequency The PWM frequency in Hz
+	 * @param minDuty The duty percentage at which the motor begins to spin
+	 * @param maxDuty The duty percentage at full throttle
+	 * @param thrustExpo The quadratic share of the thrust curve, 0 is linear and 1 is pure quadratic
+	 */
+	ThrottleCurve(float frequency, float minDuty, float maxDuty, float thrustExpo);
+
+	/**
+	 * @brief Update the duty range and modelled thrust curve, rebuilding the lookup table only for what changed
+	 *
+	 * A new duty range rescales the current curve, so a measured curve is kept. A new expo replaces the curve
+	 * with the model.
+	 *
+	 * @param frequency The PWM frequency in Hz
+	 * @param minDuty The duty percentage at which the motor begins to spin
+	 * @param maxDuty The duty percentage at full throttle
+	 * @param thrustExpo The quadratic share of the thrust curve, 0 is linear and 1 is pure quadratic
+	 */
+	void configure(float frequency, float minDuty, float maxDuty, float thrustExpo);
+
+	/**
+	 * @brief Rebuild the lookup table from a measured thrust curve, keeping the current duty range
+	 *
+	 * @param thrust Measured thrust at evenly spaced commands from min duty to max duty, in any unit
+	 * @param numPoints The number of measurements, between 2 and THROTTLE_CURVE_MAX_MEASURED_POINTS
+	 *
+	 * @return
+	 * 		- true Table rebuilt
+	 * 		- false Measurements are not finite, not strictly increasing overall or numPoints is out of range
+	 */
+	bool setMeasuredCurve(const float * thrust, uint8_t numPoints);
+
+	/**
+	 * @brief Get the pulse width producing a given percentage of full thrust
+	 *
+	 * @param thrustPercentage The thrust percentage, 0 is off and 100 is max
+	 *
+	 * @return The pulse width in microseconds, 0 for off
+	 */
+	inline uint32_t getPulseWidth(float thrustPercentage) const
+	{
+		//Turn off completely on 0 input
+		if(!(thrustPercentage >= .01f))
+			return 0;
+
+		float position = thrustPercentage * (THROTTLE_CURVE_SEGMENTS * .01f);
+		int index = (int)position;
+
+		if(index >= THROTTLE_CURVE_SEGMENTS)
+			return this->pulseTable[THROTTLE_CURVE_SEGMENTS];
+
+		int low = this->pulseTable[index];
+		return low + (int)((this->pulseTable[index + 1] - low) * (position - index) + .5f);
+	}
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <stdio.h>
+
+/**
+ * Minimal host test helpers: each test program counts failed checks and returns non-zero from main if any failed
+ */
+
+static int testFailures = 0;
+static int testChecks = 0;
+
+#define TEST_CHECK(condition) \
+	do \
+	{ \
+		testChecks++; \
+		if(!(condition)) \
+		{ \
+			testFailures++; \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		} \
+	} while(0)
+
+#define TEST_REPORT(name) \
+	(printf("%s: %d checks, %d failed\n", name, testChecks, testFailures), testFailures == 0 ? 0 : 1)
+
+#endif
@@ -0,0 +1,196 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Benchmarks the hardware independent hot paths on the host and gates them against benchmark_baseline.txt.
+ *
+ *   benchmark <baseline file>           run, print one line of JSON and exit non-zero on a regression
+ *   benchmark <baseline file> --update  run and rewrite the baseline file from this run
+ *
+ * The cases are shared with the Benchmark sketch through examples/Benchmark/BenchmarkCases.h.
+ * Means are nanoseconds per iteration, from the best of many short rounds. Each round runs every case in turn, so
+ * a burst of contention from the rest of the machine, which can double the time for tens of milliseconds, spoils a
+ * few rounds of every case rather than all the rounds of one. A case without a baseline fails, so new cases must be
+ * recorded before the gate passes.
+ */
+
+#include "BenchmarkCases.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_ITERATIONS 2000
+#define BENCHMARK_ROUNDS 1000
+#define BENCHMARK_MAX_BASELINES 32
+#define BENCHMARK_NAME_LENGTH 48
+
+//A benchmark fails when its mean exceeds the baseline mean by more than this percentage
+#define BENCHMARK_TOLERANCE_PERCENT 20
+
+typedef struct
+{
+	char name[BENCHMARK_NAME_LENGTH];
+	double meanNs;
+} BenchmarkBaseline;
+
+double meanNs[NUM_BENCHMARKS];
+
+static double nowNs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static double timeRound(const BenchmarkCase * benchmark)
+{
+	double start = nowNs();
+
+	for(uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++)
+		benchmark->run(i);
+
+	return (nowNs() - start) / BENCHMARK_ITERATIONS;
+}
+
+//Run every case once per round and keep each case's best round
+static void runBenchmarks()
+{
+	//Warm up the caches and the telemetry and control clocks
+	for(size_t i = 0; i < NUM_BENCHMARKS; i++)
+		timeRound(&benchmarks[i]);
+
+	for(int round = 0; round < BENCHMARK_ROUNDS; round++)
+	{
+		for(size_t i = 0; i < NUM_BENCHMARKS; i++)
+		{
+			double roundNs = timeRound(&benchmarks[i]);
+
+			if(round == 0 || roundNs < meanNs[i])
+				meanNs[i] = roundNs;
+		}
+	}
+}
+
+static int loadBaselines(const char * path, BenchmarkBaseline * baselines)
+{
+	FILE * file = fopen(path, "r");
+	int count = 0;
+
+	if(file == 0)
+		return 0;
+
+	char line[128];
+
+	while(count < BENCHMARK_MAX_BASELINES && fgets(line, sizeof(line), file) != 0)
+	{
+		if(line[0] == '#')
+			continue;
+
+		if(sscanf(line, "%47s %lf", baselines[count].name, &baselines[count].meanNs) == 2)
+			count++;
+	}
+
+	fclose(file);
+	return count;
+}
+
+static bool saveBaselines(const char * path)
+{
+	FILE * file = fopen(path, "w");
+
+	if(file == 0)
+		return false;
+
+	fprintf(file, "# Host benchmark baselines, mean nanoseconds per iteration. Regenerate with make -C test bench-baseline\n");
+
+	for(size_t i = 0; i < NUM_BENCHMARKS; i++)
+		fprintf(file, "%s %.1f\n", benchmarks[i].name, meanNs[i]);
+
+	fclose(file);
+	return true;
+}
+
+static double findBaseline(const BenchmarkBaseline * baselines, int count, const char * name)
+{
+	for(int i = 0; i < count; i++)
+	{
+		if(strcmp(baselines[i].name, name) == 0)
+			return baselines[i].meanNs;
+	}
+
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	if(argc < 2)
+	{
+		printf("usage: %s <baseline file> [--update]\n", argv[0]);
+		return 2;
+	}
+
+	bool update = argc > 2 && strcmp(argv[2], "--update") == 0;
+
+	//Arm so the throttle and control tick cases run the armed path
+	if(!setupBenchmarks() || !armBenchmarks())
+	{
+		printf("BENCHMARK could not arm the flight controller\n");
+		return 1;
+	}
+
+	BenchmarkBaseline baselines[BENCHMARK_MAX_BASELINES];
+	int numBaselines = loadBaselines(argv[1], baselines);
+	bool allPassed = true;
+
+	printf("{\"iterations\":%u,\"rounds\":%u,\"tolerance_percent\":%u,\"benchmarks\":[",
+		BENCHMARK_ITERATIONS, BENCHMARK_ROUNDS, BENCHMARK_TOLERANCE_PERCENT);
+
+	runBenchmarks();
+
+	for(size_t i = 0; i < NUM_BENCHMARKS; i++)
+	{
+		double baseline = findBaseline(baselines, numBaselines, benchmarks[i].name);
+		bool passed = baseline > 0 && meanNs[i] * 100 <= baseline * (100 + BENCHMARK_TOLERANCE_PERCENT);
+
+		allPassed = allPassed && passed;
+
+		printf("%s{\"name\":\"%s\",\"mean_ns\":%.1f,\"baseline_ns\":%.1f,\"pass\":%s}", i ? "," : "", benchmarks[i].name,
+			meanNs[i], baseline, passed ? "true" : "false");
+	}
+
+	printf("],\"telemetry_bytes_per_s\":%u,\"pass\":%s}\n", (unsigned)telemetry.getBytesPerSecond(), allPassed ? "true" : "false");
+
+	if(update)
+	{
+		if(!saveBaselines(argv[1]))
+		{
+			printf("BENCHMARK could not write %s\n", argv[1]);
+			return 1;
+		}
+
+		printf("BENCHMARK baselines written to %s\n", argv[1]);
+		return 0;
+	}
+
+	printf(allPassed ? "BENCHMARK PASS\n" : "BENCHMARK FAIL\n");
+	return allPassed ? 0 : 1;
+}
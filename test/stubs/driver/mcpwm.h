@@ -0,0 +1,90 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef MCPWM_STUB_H
+#define MCPWM_STUB_H
+
+#include <stdint.h>
+
+/**
+ * Host stand-in for the ESP-IDF MCPWM driver, recording the output of every generator instead of driving pins
+ */
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum {MCPWM_UNIT_0, MCPWM_UNIT_1, MCPWM_UNIT_MAX} mcpwm_unit_t;
+typedef enum {MCPWM_TIMER_0, MCPWM_TIMER_1, MCPWM_TIMER_2, MCPWM_TIMER_MAX} mcpwm_timer_t;
+typedef enum {MCPWM_OPR_A, MCPWM_OPR_B} mcpwm_operator_t;
+typedef enum {MCPWM_DUTY_MODE_0, MCPWM_DUTY_MODE_1} mcpwm_duty_type_t;
+typedef enum {MCPWM_UP_COUNTER} mcpwm_counter_type_t;
+typedef enum {MCPWM0A, MCPWM0B, MCPWM1A, MCPWM1B, MCPWM2A, MCPWM2B} mcpwm_io_signals_t;
+
+typedef struct
+{
+	uint32_t frequency;
+	float cmpr_a;
+	float cmpr_b;
+	mcpwm_duty_type_t duty_mode;
+	mcpwm_counter_type_t counter_mode;
+} mcpwm_config_t;
+
+/**
+ * @brief Recorded state of one MCPWM timer and its operator A generator
+ */
+typedef struct
+{
+	uint32_t frequency;
+	uint32_t pulseWidth;
+	bool running;
+	bool forcedLow;
+	uint32_t forceCount;
+
+	//Set by a test to make every driver call on this channel fail, or only mcpwm_stop
+	bool failing;
+	bool stopFails;
+} mcpwm_stub_channel_t;
+
+//Recorded state per unit and timer, cleared by mcpwm_stub_reset()
+extern mcpwm_stub_channel_t mcpwmStubChannels[MCPWM_UNIT_MAX][MCPWM_TIMER_MAX];
+
+//When true every driver call on every channel fails with ESP_FAIL
+extern bool mcpwmStubFail;
+
+/**
+ * @brief Clear all recorded channel state and stop failing driver calls
+ */
+void mcpwm_stub_reset();
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t mcpwm_num, mcpwm_io_signals_t io_signal, int gpio_num);
+esp_err_t mcpwm_init(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, const mcpwm_config_t * mcpwm_conf);
+esp_err_t mcpwm_set_frequency(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, uint32_t frequency);
+esp_err_t mcpwm_start(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num);
+esp_err_t mcpwm_stop(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num);
+esp_err_t mcpwm_set_duty(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num, float duty);
+esp_err_t mcpwm_set_duty_in_us(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num, uint32_t duty_in_us);
+esp_err_t mcpwm_set_signal_low(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num);
+esp_err_t mcpwm_set_duty_type(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num, mcpwm_duty_type_t duty_type);
+
+#endif
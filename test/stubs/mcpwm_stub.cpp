@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "driver/mcpwm.h"
+#include <string.h>
+
+mcpwm_stub_channel_t mcpwmStubChannels[MCPWM_UNIT_MAX][MCPWM_TIMER_MAX];
+bool mcpwmStubFail = false;
+
+static bool channelFails(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num)
+{
+	return mcpwmStubFail || mcpwmStubChannels[mcpwm_num][timer_num].failing;
+}
+
+void mcpwm_stub_reset()
+{
+	memset(mcpwmStubChannels, 0, sizeof(mcpwmStubChannels));
+	mcpwmStubFail = false;
+}
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t mcpwm_num, mcpwm_io_signals_t io_signal, int gpio_num)
+{
+	(void)mcpwm_num;
+	(void)io_signal;
+	(void)gpio_num;
+	return mcpwmStubFail ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t mcpwm_init(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, const mcpwm_config_t * mcpwm_conf)
+{
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	mcpwmStubChannels[mcpwm_num][timer_num].frequency = mcpwm_conf->frequency;
+	mcpwmStubChannels[mcpwm_num][timer_num].running = true;
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_set_frequency(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, uint32_t frequency)
+{
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	mcpwmStubChannels[mcpwm_num][timer_num].frequency = frequency;
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_start(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num)
+{
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	mcpwmStubChannels[mcpwm_num][timer_num].running = true;
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_stop(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num)
+{
+	if(channelFails(mcpwm_num, timer_num) || mcpwmStubChannels[mcpwm_num][timer_num].stopFails)
+		return ESP_FAIL;
+
+	mcpwmStubChannels[mcpwm_num][timer_num].running = false;
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_set_duty(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num, float duty)
+{
+	mcpwm_stub_channel_t * channel = &mcpwmStubChannels[mcpwm_num][timer_num];
+
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	if(op_num == MCPWM_OPR_A && channel->frequency > 0)
+		channel->pulseWidth = (uint32_t)(duty * 10000.0f / channel->frequency + .5f);
+
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_set_duty_in_us(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num, uint32_t duty_in_us)
+{
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	if(op_num == MCPWM_OPR_A)
+		mcpwmStubChannels[mcpwm_num][timer_num].pulseWidth = duty_in_us;
+
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_set_signal_low(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num)
+{
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	if(op_num == MCPWM_OPR_A)
+	{
+		mcpwmStubChannels[mcpwm_num][timer_num].forcedLow = true;
+		mcpwmStubChannels[mcpwm_num][timer_num].forceCount++;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t mcpwm_set_duty_type(mcpwm_unit_t mcpwm_num, mcpwm_timer_t timer_num, mcpwm_operator_t op_num, mcpwm_duty_type_t duty_type)
+{
+	(void)duty_type;
+
+	if(channelFails(mcpwm_num, timer_num))
+		return ESP_FAIL;
+
+	//Setting a duty type again releases a forced output
+	if(op_num == MCPWM_OPR_A)
+		mcpwmStubChannels[mcpwm_num][timer_num].forcedLow = false;
+
+	return ESP_OK;
+}
@@ -0,0 +1,312 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "TestUtil.h"
+#include "Failsafe.h"
+
+/*
+ * Simulates the watchdog timer and a jittery control loop in microseconds, stalls the loop at many points
+ * relative to the timer phase, and measures the time from the last feed until every output is forced low.
+ * Also checks the link loss stages, IMU staleness and a cutoff with one failing ESC.
+ */
+
+#define SIM_NUM_ESCS 4
+#define SIM_LOOP_PERIOD_US 2000
+#define SIM_RUN_BEFORE_STALL_US 200000
+#define SIM_PHASE_STEPS 97
+#define SIM_STALL_STEPS 13
+
+static ESCControl escs[SIM_NUM_ESCS] =
+{
+	ESCControl(PIN_33, MCPWM_UNIT_0, MCPWM_TIMER_0),
+	ESCControl(PIN_15, MCPWM_UNIT_0, MCPWM_TIMER_1),
+	ESCControl(PIN_32, MCPWM_UNIT_1, MCPWM_TIMER_0),
+	ESCControl(PIN_14, MCPWM_UNIT_1, MCPWM_TIMER_1)
+};
+
+static ESCControl * escPointers[SIM_NUM_ESCS] = {&escs[0], &escs[1], &escs[2], &escs[3]};
+
+static uint32_t randomState = 12345;
+
+static uint32_t nextRandom()
+{
+	randomState = randomState * 1103515245u + 12345u;
+	return randomState >> 8;
+}
+
+static bool allForcedLow()
+{
+	for(int i = 0; i < SIM_NUM_ESCS; i++)
+	{
+		if(!mcpwmStubChannels[i / 2][i % 2].forcedLow)
+			return false;
+	}
+
+	return true;
+}
+
+static bool anyForcedLow()
+{
+	for(int i = 0; i < SIM_NUM_ESCS; i++)
+	{
+		if(mcpwmStubChannels[i / 2][i % 2].forcedLow)
+			return true;
+	}
+
+	return false;
+}
+
+typedef struct
+{
+	uint32_t minUs;
+	uint32_t maxUs;
+	uint64_t totalUs;
+	uint32_t runs;
+	uint32_t falseTrips;
+	uint32_t missedTrips;
+} LatencyStats;
+
+/**
+ * @brief Run one armed flight that stalls at stallUs, with the watchdog timer starting at phaseUs
+ *
+ * @return The time from the last feed until every output was forced low, or 0 if it never was
+ */
+static uint32_t simulateStall(Failsafe * failsafe, uint32_t periodUs, uint32_t phaseUs, uint32_t jitterUs, uint32_t stallUs,
+	LatencyStats * stats)
+{
+	mcpwm_stub_reset();
+
+	for(int i = 0; i < SIM_NUM_ESCS; i++)
+	{
+		escs[i].init();
+		escs[i].start();
+	}
+
+	failsafe->enable();
+
+	uint64_t nextTimerUs = phaseUs;
+	uint64_t nextFeedUs = 0;
+	uint64_t lastFeedUs = 0;
+
+	//Give up well past the bound so a missed trip shows up as a failure rather than a hang
+	uint64_t endUs = stallUs + 10 * (uint64_t)periodUs * FAILSAFE_DEFAULT_MISSED_TICKS;
+
+	while(nextTimerUs < endUs)
+	{
+		//A feed landing on the same microsecond as the interrupt is handled first
+		if(nextFeedUs < stallUs && nextFeedUs <= nextTimerUs)
+		{
+			failsafe->feed();
+			lastFeedUs = nextFeedUs;
+			nextFeedUs += SIM_LOOP_PERIOD_US - jitterUs + nextRandom() % (2 * jitterUs + 1);
+			continue;
+		}
+
+		failsafe->onWatchdogTimer();
+
+		if(allForcedLow())
+		{
+			if(nextTimerUs < stallUs)
+			{
+				stats->falseTrips++;
+				return 0;
+			}
+
+			return (uint32_t)(nextTimerUs - lastFeedUs);
+		}
+
+		if(anyForcedLow())
+			break;
+
+		nextTimerUs += periodUs;
+	}
+
+	stats->missedTrips++;
+	return 0;
+}
+
+static LatencyStats measureLatency(uint32_t periodUs, uint32_t jitterUs)
+{
+	Failsafe failsafe(escPointers, SIM_NUM_ESCS);
+	failsafe.setWatchdog(periodUs, FAILSAFE_DEFAULT_MISSED_TICKS);
+
+	LatencyStats stats = {UINT32_MAX, 0, 0, 0, 0, 0};
+
+	//Sweep where the stall lands against the timer phase, and the timer phase against the loop
+	for(uint32_t phaseStep = 0; phaseStep < SIM_PHASE_STEPS; phaseStep++)
+	{
+		for(uint32_t stallStep = 0; stallStep < SIM_STALL_STEPS; stallStep++)
+		{
+			uint32_t phaseUs = periodUs * phaseStep / SIM_PHASE_STEPS;
+			uint32_t stallUs = SIM_RUN_BEFORE_STALL_US + periodUs * stallStep / SIM_STALL_STEPS;
+			uint32_t latencyUs = simulateStall(&failsafe, periodUs, phaseUs, jitterUs, stallUs, &stats);
+
+			if(latencyUs == 0)
+				continue;
+
+			stats.runs++;
+			stats.totalUs += latencyUs;
+
+			if(latencyUs < stats.minUs)
+				stats.minUs = latencyUs;
+
+			if(latencyUs > stats.maxUs)
+				stats.maxUs = latencyUs;
+		}
+	}
+
+	printf("cutoff latency period %uus jitter %uus: min %uus mean %uus max %uus over %u stalls (bound %uus, cutoff %u cycles)\n",
+		(unsigned)periodUs, (unsigned)jitterUs, (unsigned)stats.minUs, (unsigned)(stats.runs ? stats.totalUs / stats.runs : 0),
+		(unsigned)stats.maxUs, (unsigned)stats.runs, (unsigned)failsafe.getWorstCaseDetectionUs(),
+		(unsigned)failsafe.getMaxCutoffCycles());
+
+	return stats;
+}
+
+static void testCutoffLatency()
+{
+	const uint32_t jitters[] = {0, 500, 1500};
+	const uint32_t periods[] = {FAILSAFE_DEFAULT_PERIOD_US, 2500};
+
+	for(int p = 0; p < 2; p++)
+	{
+		uint32_t bound = periods[p] * FAILSAFE_DEFAULT_MISSED_TICKS;
+
+		for(int j = 0; j < 3; j++)
+		{
+			LatencyStats stats = measureLatency(periods[p], jitters[j]);
+
+			//Cut off within the missed tick bound of the last feed, and no sooner than one tick short of it
+			TEST_CHECK(stats.runs == SIM_PHASE_STEPS * SIM_STALL_STEPS);
+			TEST_CHECK(stats.falseTrips == 0);
+			TEST_CHECK(stats.missedTrips == 0);
+			TEST_CHECK(stats.maxUs <= bound);
+			TEST_CHECK(stats.minUs >= bound - periods[p]);
+		}
+	}
+}
+
+static void testDisabled()
+{
+	Failsafe failsafe(escPointers, SIM_NUM_ESCS);
+	mcpwm_stub_reset();
+
+	//A disarmed watchdog never cuts off, and one that tripped stays tripped until enabled again
+	for(int i = 0; i < 10; i++)
+		failsafe.onWatchdogTimer();
+
+	TEST_CHECK(!anyForcedLow());
+	TEST_CHECK(!failsafe.isTripped());
+
+	failsafe.enable();
+
+	for(int i = 0; i < FAILSAFE_DEFAULT_MISSED_TICKS; i++)
+		failsafe.onWatchdogTimer();
+
+	TEST_CHECK(failsafe.isTripped());
+	TEST_CHECK(allForcedLow());
+	TEST_CHECK(failsafe.evaluate(0) == FAILSAFE_DISARM);
+
+	for(int i = 0; i < SIM_NUM_ESCS; i++)
+		TEST_CHECK(mcpwmStubChannels[i / 2][i % 2].forceCount == 1);
+
+	failsafe.enable();
+	TEST_CHECK(!failsafe.isTripped());
+}
+
+static void testCutoffFailure()
+{
+	Failsafe failsafe(escPointers, SIM_NUM_ESCS);
+	mcpwm_stub_reset();
+
+	//One ESC that cannot be forced low does not stop the others from being cut
+	mcpwmStubChannels[0][1].failing = true;
+	TEST_CHECK(!failsafe.cutoff());
+	TEST_CHECK(!mcpwmStubChannels[0][1].forcedLow);
+
+	for(int i = 0; i < SIM_NUM_ESCS; i++)
+	{
+		if(i != 1)
+			TEST_CHECK(mcpwmStubChannels[i / 2][i % 2].forcedLow);
+	}
+
+	mcpwm_stub_reset();
+}
+
+static void testLinkLoss()
+{
+	Failsafe failsafe(escPointers, SIM_NUM_ESCS);
+	failsafe.setLinkTimeouts(FAILSAFE_DEFAULT_HOLD_MS, FAILSAFE_DEFAULT_DESCEND_MS, FAILSAFE_DEFAULT_DISARM_MS);
+	failsafe.setImuTimeout(0);
+
+	//Link timing starts at the first evaluate after enabling, not at the last command before arming
+	failsafe.onCommand(0);
+	failsafe.enable();
+	uint32_t startMs = 60000;
+	TEST_CHECK(failsafe.evaluate(startMs) == FAILSAFE_NONE);
+
+	//Each stage begins exactly at its threshold
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_HOLD_MS - 1) == FAILSAFE_NONE);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_HOLD_MS) == FAILSAFE_HOLD);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_DESCEND_MS - 1) == FAILSAFE_HOLD);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_DESCEND_MS) == FAILSAFE_DESCEND);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_DISARM_MS - 1) == FAILSAFE_DESCEND);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_DISARM_MS) == FAILSAFE_DISARM);
+
+	//A command resets the stages, even one arriving while descending
+	failsafe.onCommand(startMs + FAILSAFE_DEFAULT_DISARM_MS);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_DISARM_MS + 1) == FAILSAFE_NONE);
+	TEST_CHECK(failsafe.evaluate(startMs + FAILSAFE_DEFAULT_DISARM_MS + FAILSAFE_DEFAULT_HOLD_MS) == FAILSAFE_HOLD);
+}
+
+static void testImuStale()
+{
+	Failsafe failsafe(escPointers, SIM_NUM_ESCS);
+	failsafe.setLinkTimeouts(FAILSAFE_DEFAULT_HOLD_MS, FAILSAFE_DEFAULT_DESCEND_MS, FAILSAFE_DEFAULT_DISARM_MS);
+	failsafe.setImuTimeout(FAILSAFE_DEFAULT_IMU_STALE_MS);
+	failsafe.enable();
+
+	//Flying without an IMU never trips the staleness check
+	TEST_CHECK(failsafe.evaluate(1000) == FAILSAFE_NONE);
+	failsafe.onCommand(1000);
+
+	failsafe.onImuSample(1000);
+	TEST_CHECK(failsafe.evaluate(1000 + FAILSAFE_DEFAULT_IMU_STALE_MS) == FAILSAFE_NONE);
+	TEST_CHECK(failsafe.evaluate(1000 + FAILSAFE_DEFAULT_IMU_STALE_MS + 1) == FAILSAFE_DISARM);
+
+	//Fresh samples clear it, and a zero timeout disables it
+	failsafe.onImuSample(1100);
+	TEST_CHECK(failsafe.evaluate(1100) == FAILSAFE_NONE);
+
+	failsafe.setImuTimeout(0);
+	TEST_CHECK(failsafe.evaluate(1000 + FAILSAFE_DEFAULT_HOLD_MS - 1) == FAILSAFE_NONE);
+}
+
+int main()
+{
+	testCutoffLatency();
+	testDisabled();
+	testCutoffFailure();
+	testLinkLoss();
+	testImuStale();
+	return TEST_REPORT("test_failsafe");
+}
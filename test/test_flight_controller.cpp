@@ -0,0 +1,461 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "TestUtil.h"
+#include "FlightController.h"
+
+#include <string.h>
+
+/*
+ * Runs the flight controller from boot through the pre-arm checks with a stub sensor, measuring boot to ready
+ * and checking that stale samples, failing sensors and missing ESCs are handled. Once armed, it checks the link
+ * loss descent, the disarm on a stale IMU and that kill() reaches every motor when one fails to stop.
+ */
+
+#define SIM_TICK_MS 2
+#define SIM_TIMEOUT_MS 20000
+
+/**
+ * @brief A sensor that produces a new sample every few reads, with optional noise and failures
+ */
+class StubAccelerometer : public BaseAccelerometer
+{
+public:
+	bool beginResult;
+	bool identityResult;
+	uint32_t beginCalls;
+
+	//A new sample is ready on every samplePeriod-th call to hasNewData
+	uint32_t samplePeriod;
+	uint32_t polls;
+
+	//Peak pitch and roll change between samples in degrees
+	float noise;
+	uint32_t samples;
+
+	StubAccelerometer() : BaseAccelerometer(0)
+	{
+		this->beginResult = true;
+		this->identityResult = true;
+		this->beginCalls = 0;
+		this->samplePeriod = 1;
+		this->polls = 0;
+		this->noise = 0;
+		this->samples = 0;
+	};
+
+	bool begin()
+	{
+		this->beginCalls++;
+		return this->beginResult;
+	};
+
+	bool checkIdentity()
+	{
+		return this->identityResult;
+	};
+
+	bool hasNewData()
+	{
+		if(++this->polls < this->samplePeriod)
+			return false;
+
+		this->polls = 0;
+		this->samples++;
+		return true;
+	};
+
+	uint8_t read(uint8_t reg)
+	{
+		return reg;
+	};
+
+	void write(uint8_t reg, uint8_t data)
+	{
+		(void)reg;
+		(void)data;
+	};
+
+	float readPitch()
+	{
+		return this->samples % 2 ? this->noise : -this->noise;
+	};
+
+	float readRoll()
+	{
+		return this->samples % 2 ? -this->noise : this->noise;
+	};
+
+	float readYaw()
+	{
+		return 0;
+	};
+
+	float readAccelX()
+	{
+		return 0;
+	};
+
+	float readAccelY()
+	{
+		return 0;
+	};
+
+	float readAccelZ()
+	{
+		return 1;
+	};
+};
+
+/**
+ * @brief Tick the controller until it reaches READY or the timeout passes
+ *
+ * @return The simulated time when the loop stopped
+ */
+static uint32_t runUntilReady(FlightController * fc, uint32_t nowMs, uint32_t timeoutMs)
+{
+	uint32_t endMs = nowMs + timeoutMs;
+
+	while(fc->getMode() != MODE_READY && nowMs < endMs)
+	{
+		nowMs += SIM_TICK_MS;
+		fc->update(nowMs);
+	}
+
+	return nowMs;
+}
+
+static void testBootToReady()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	TEST_CHECK(fc.setAccelerometer(&imu));
+	TEST_CHECK(fc.init());
+	TEST_CHECK(fc.getMode() == MODE_CALIBRATING);
+
+	runUntilReady(&fc, 0, SIM_TIMEOUT_MS);
+
+	//One tick per check, plus the shared prearm_window_ms window for the sample rate and noise checks
+	uint32_t bootToReadyMs = fc.getBootToReadyMs();
+	uint32_t windowMs = fc.getParameters()->getInt(PARAM_PREARM_WINDOW_MS);
+	printf("boot to ready: %ums with a %ums window and %ums ticks\n", (unsigned)bootToReadyMs, (unsigned)windowMs,
+		(unsigned)SIM_TICK_MS);
+
+	TEST_CHECK(fc.getMode() == MODE_READY);
+	TEST_CHECK(fc.getFailedCheck() == 0);
+	TEST_CHECK(bootToReadyMs >= windowMs);
+	TEST_CHECK(bootToReadyMs <= windowMs + NUM_PREARM_CHECKS * SIM_TICK_MS);
+	TEST_CHECK(sensor.beginCalls == 1);
+
+	//Nothing can be saved while the motors run
+	TEST_CHECK(fc.arm());
+	TEST_CHECK(fc.getMode() == MODE_ARMED);
+	TEST_CHECK(!fc.saveParameters());
+	TEST_CHECK(fc.kill());
+	TEST_CHECK(fc.getMode() == MODE_READY);
+	TEST_CHECK(fc.saveParameters());
+	remove(PARAMETER_FILE_PATH);
+}
+
+static void testNoDriver()
+{
+	Accelerometer imu(MPU6050);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	//Without a driver imu_init could never pass, so the sensor is refused
+	TEST_CHECK(!imu.hasDriver());
+	TEST_CHECK(!imu.update());
+	TEST_CHECK(!fc.setAccelerometer(&imu));
+	TEST_CHECK(fc.init());
+
+	runUntilReady(&fc, 0, SIM_TIMEOUT_MS);
+	TEST_CHECK(fc.getMode() == MODE_READY);
+}
+
+static void testStaleSamples()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	//A new sample every tenth tick is 50Hz, below prearm_min_imu_rate_hz however often update() runs
+	sensor.samplePeriod = 10;
+	fc.setAccelerometer(&imu);
+	fc.init();
+
+	runUntilReady(&fc, 0, 2000);
+
+	TEST_CHECK(fc.getMode() == MODE_CALIBRATING);
+	TEST_CHECK(fc.getFailedCheck() != 0 && strcmp(fc.getFailedCheck(), "imu_sample_rate") == 0);
+}
+
+static void testNoise()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	//Alternating by a degree is a variance of 1, over the default limit
+	sensor.noise = 1;
+	fc.setAccelerometer(&imu);
+	fc.init();
+
+	runUntilReady(&fc, 0, 2000);
+
+	TEST_CHECK(fc.getMode() == MODE_CALIBRATING);
+	TEST_CHECK(fc.getFailedCheck() != 0 && strcmp(fc.getFailedCheck(), "imu_noise") == 0);
+}
+
+static void testRetryBackoff()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	sensor.beginResult = false;
+	fc.setAccelerometer(&imu);
+	fc.init();
+
+	//Waits of 100, 200, 400, 800, 1600, 3200 and then 5000ms between attempts
+	uint32_t nowMs = runUntilReady(&fc, 0, 10000);
+
+	printf("retry backoff: %u imu_init attempts in %ums\n", (unsigned)sensor.beginCalls, (unsigned)nowMs);
+	TEST_CHECK(fc.getMode() == MODE_CALIBRATING);
+	TEST_CHECK(fc.getFailedCheck() != 0 && strcmp(fc.getFailedCheck(), "imu_init") == 0);
+	TEST_CHECK(sensor.beginCalls >= 7 && sensor.beginCalls <= 9);
+
+	//Once the sensor answers, the next attempt after at most the longest wait gets through
+	sensor.beginResult = true;
+	uint32_t recoveredMs = runUntilReady(&fc, nowMs, SIM_TIMEOUT_MS);
+
+	TEST_CHECK(fc.getMode() == MODE_READY);
+	TEST_CHECK(recoveredMs - nowMs <= PREARM_RETRY_MAX_MS + 600);
+
+	//Asking for a calibration starts the checks at once
+	uint32_t calls = sensor.beginCalls;
+	TEST_CHECK(fc.calibrate());
+	fc.update(recoveredMs + SIM_TICK_MS);
+	fc.update(recoveredMs + 2 * SIM_TICK_MS);
+	TEST_CHECK(sensor.beginCalls == calls + 1);
+}
+
+/**
+ * @brief Boot a controller with a stub sensor and arm it at the returned time
+ */
+static uint32_t bootAndArm(FlightController * fc, Accelerometer * imu)
+{
+	mcpwm_stub_reset();
+	fc->setAccelerometer(imu);
+	fc->init();
+
+	uint32_t nowMs = runUntilReady(fc, 0, SIM_TIMEOUT_MS);
+	fc->onCommand(nowMs);
+	TEST_CHECK(fc->arm());
+	return nowMs;
+}
+
+static bool anyMotorRunning()
+{
+	for(int i = 0; i < NUM_MOTORS; i++)
+	{
+		if(mcpwmStubChannels[i / 2][i % 2].running)
+			return true;
+	}
+
+	return false;
+}
+
+static void testLinkLossDescent()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+	const mcpwm_stub_channel_t * frontLeft = &mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_0];
+
+	uint32_t armedMs = bootAndArm(&fc, &imu);
+	TEST_CHECK(fc.throttleAll(50));
+	uint32_t cruisePulse = frontLeft->pulseWidth;
+
+	//With no commands after arming: hold, then wind the throttle down at failsafe_descend_rate, then disarm.
+	//Link timing starts at the first tick after arming
+	uint32_t startMs = armedMs + SIM_TICK_MS;
+	uint32_t nowMs = armedMs;
+	uint32_t lastPulse = cruisePulse;
+	uint32_t disarmedMs = 0;
+	bool held = true;
+	bool monotonic = true;
+	FailsafeAction holdAction = FAILSAFE_NONE;
+	FailsafeAction action = FAILSAFE_NONE;
+
+	while(fc.getMode() == MODE_ARMED && nowMs < armedMs + SIM_TIMEOUT_MS)
+	{
+		nowMs += SIM_TICK_MS;
+		action = fc.update(nowMs);
+		uint32_t sinceStartMs = nowMs - startMs;
+
+		if(sinceStartMs == FAILSAFE_DEFAULT_HOLD_MS)
+			holdAction = action;
+
+		if(sinceStartMs < FAILSAFE_DEFAULT_DESCEND_MS)
+			held = held && frontLeft->pulseWidth == cruisePulse;
+
+		monotonic = monotonic && frontLeft->pulseWidth <= lastPulse;
+		lastPulse = frontLeft->pulseWidth;
+		disarmedMs = sinceStartMs;
+	}
+
+	//50% at 10% per second runs out 5s into the descent, before failsafe_disarm_ms
+	uint32_t expectedMs = FAILSAFE_DEFAULT_DESCEND_MS + 50 * 1000 / FAILSAFE_DEFAULT_DESCEND_RATE;
+	printf("link loss: held %ums, descended until %ums after link timing started\n", (unsigned)FAILSAFE_DEFAULT_DESCEND_MS,
+		(unsigned)disarmedMs);
+
+	TEST_CHECK(holdAction == FAILSAFE_HOLD);
+	TEST_CHECK(held);
+	TEST_CHECK(monotonic);
+	TEST_CHECK(lastPulse < cruisePulse);
+	TEST_CHECK(action == FAILSAFE_DISARM);
+	TEST_CHECK(fc.getMode() == MODE_FAILSAFE);
+	TEST_CHECK(!fc.throttleAll(50));
+	TEST_CHECK(disarmedMs + 2 * SIM_TICK_MS >= expectedMs && disarmedMs <= expectedMs + 2 * SIM_TICK_MS);
+	TEST_CHECK(!anyMotorRunning());
+
+	//Without a descent to wind down, failsafe_disarm_ms disarms on its own
+	FlightController idle(PIN_33, PIN_15, PIN_32, PIN_14);
+	StubAccelerometer idleSensor;
+	Accelerometer idleImu(&idleSensor);
+	armedMs = bootAndArm(&idle, &idleImu);
+	TEST_CHECK(idle.getParameters()->setInt(PARAM_FAILSAFE_DESCEND_MS, 20000) == PARAM_OK);
+	TEST_CHECK(idle.getParameters()->setInt(PARAM_FAILSAFE_DISARM_MS, 3000) == PARAM_OK);
+	TEST_CHECK(idle.getParameters()->commit() == PARAM_OK);
+
+	for(nowMs = armedMs; idle.getMode() == MODE_ARMED && nowMs < armedMs + SIM_TIMEOUT_MS; )
+	{
+		nowMs += SIM_TICK_MS;
+		idle.update(nowMs);
+	}
+
+	TEST_CHECK(idle.getMode() == MODE_FAILSAFE);
+	TEST_CHECK(nowMs - (armedMs + SIM_TICK_MS) == 3000);
+}
+
+static void testImuStaleDisarm()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	uint32_t nowMs = bootAndArm(&fc, &imu);
+	TEST_CHECK(fc.throttleAll(40));
+
+	//The sensor stops producing samples while commands keep arriving
+	sensor.samplePeriod = UINT32_MAX;
+	uint32_t lastSampleMs = nowMs;
+	FailsafeAction action = FAILSAFE_NONE;
+
+	while(fc.getMode() == MODE_ARMED && nowMs < lastSampleMs + 1000)
+	{
+		nowMs += SIM_TICK_MS;
+		fc.onCommand(nowMs);
+		action = fc.update(nowMs);
+	}
+
+	TEST_CHECK(action == FAILSAFE_DISARM);
+	TEST_CHECK(fc.getMode() == MODE_FAILSAFE);
+	TEST_CHECK(nowMs - lastSampleMs > FAILSAFE_DEFAULT_IMU_STALE_MS);
+	TEST_CHECK(nowMs - lastSampleMs <= FAILSAFE_DEFAULT_IMU_STALE_MS + SIM_TICK_MS);
+	TEST_CHECK(!anyMotorRunning());
+}
+
+static void testKillFailingMotor()
+{
+	StubAccelerometer sensor;
+	Accelerometer imu(&sensor);
+	FlightController fc(PIN_33, PIN_15, PIN_32, PIN_14);
+
+	//A motor whose timer will not stop is forced low instead, and the rest still stop
+	bootAndArm(&fc, &imu);
+	TEST_CHECK(fc.throttleAll(30));
+	mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_1].stopFails = true;
+
+	TEST_CHECK(fc.kill());
+	TEST_CHECK(fc.getMode() == MODE_READY);
+	TEST_CHECK(mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_1].forcedLow);
+	TEST_CHECK(!mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_0].running);
+	TEST_CHECK(!mcpwmStubChannels[MCPWM_UNIT_1][MCPWM_TIMER_0].running);
+	TEST_CHECK(!mcpwmStubChannels[MCPWM_UNIT_1][MCPWM_TIMER_1].running);
+
+	//A motor that ignores every driver call is reported, but the motors after it are still stopped
+	mcpwm_stub_reset();
+	TEST_CHECK(fc.arm());
+	TEST_CHECK(fc.throttleAll(30));
+	mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_1].failing = true;
+
+	TEST_CHECK(!fc.kill());
+	TEST_CHECK(fc.getMode() == MODE_READY);
+	TEST_CHECK(!mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_0].running);
+	TEST_CHECK(!mcpwmStubChannels[MCPWM_UNIT_1][MCPWM_TIMER_0].running);
+	TEST_CHECK(!mcpwmStubChannels[MCPWM_UNIT_1][MCPWM_TIMER_1].running);
+	mcpwm_stub_reset();
+}
+
+static void testWithoutESCs()
+{
+	FlightController fc;
+
+	//Nothing exists before init creates the ESCs, and nothing may crash
+	TEST_CHECK(!fc.throttleAll(10));
+	TEST_CHECK(!fc.arm());
+	TEST_CHECK(fc.kill());
+	TEST_CHECK(fc.update(SIM_TICK_MS) == FAILSAFE_NONE);
+	TEST_CHECK(fc.getMode() == MODE_INIT);
+	TEST_CHECK(fc.getBootToReadyMs() == 0);
+
+	//Init takes the pins from the parameters
+	TEST_CHECK(fc.init());
+	runUntilReady(&fc, SIM_TICK_MS, SIM_TIMEOUT_MS);
+	TEST_CHECK(fc.getMode() == MODE_READY);
+
+	//The motors only take throttle while armed
+	TEST_CHECK(!fc.throttleAll(0));
+	TEST_CHECK(fc.arm());
+	TEST_CHECK(fc.throttleAll(0));
+	TEST_CHECK(fc.kill());
+	TEST_CHECK(!fc.throttleAll(0));
+}
+
+int main()
+{
+	remove(PARAMETER_FILE_PATH);
+
+	testBootToReady();
+	testNoDriver();
+	testStaleSamples();
+	testNoise();
+	testRetryBackoff();
+	testLinkLossDescent();
+	testImuStaleDisarm();
+	testKillFailingMotor();
+	testWithoutESCs();
+	return TEST_REPORT("test_flight_controller");
+}
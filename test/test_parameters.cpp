@@ -0,0 +1,191 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "TestUtil.h"
+#include "ParameterStore.h"
+#include <math.h>
+#include <string.h>
+
+static void testRanges()
+{
+	ParameterStore parameters;
+
+	TEST_CHECK(parameters.setInt(PARAM_ESC_FREQUENCY_HZ, 400) == PARAM_OK);
+	TEST_CHECK(parameters.setInt(PARAM_ESC_FREQUENCY_HZ, 0) == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setInt(PARAM_ESC_FREQUENCY_HZ, -50) == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_FREQUENCY_HZ, 50) == PARAM_WRONG_TYPE);
+	TEST_CHECK(parameters.setInt(PARAM_ESC_MAX_DUTY, 10) == PARAM_WRONG_TYPE);
+
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_MAX_DUTY, 0) == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_MAX_DUTY, NAN) == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_THRUST_EXPO, 1.5) == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_THRUST_EXPO, .5) == PARAM_OK);
+
+	//Rejected values are never staged
+	TEST_CHECK(parameters.commit() == PARAM_OK);
+	TEST_CHECK(parameters.apply());
+	TEST_CHECK(parameters.getInt(PARAM_ESC_FREQUENCY_HZ) == 400);
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MAX_DUTY) == 10.0f);
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_THRUST_EXPO) == .5f);
+}
+
+static void testParsing()
+{
+	ParameterStore parameters;
+
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "200") == PARAM_OK);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "200\r\n") == PARAM_OK);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "0x64") == PARAM_OK);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "") == PARAM_INVALID_VALUE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "fast") == PARAM_INVALID_VALUE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "400hz") == PARAM_INVALID_VALUE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "2.5") == PARAM_INVALID_VALUE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "0") == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_FREQUENCY_HZ, "4294967346") == PARAM_OUT_OF_RANGE);
+
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_MIN_DUTY, "4.5") == PARAM_OK);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_MIN_DUTY, "4.5.1") == PARAM_INVALID_VALUE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_MIN_DUTY, "nan") == PARAM_OUT_OF_RANGE);
+	TEST_CHECK(parameters.setFromString(PARAM_ESC_MIN_DUTY, "-1") == PARAM_OUT_OF_RANGE);
+
+	TEST_CHECK(parameters.commit() == PARAM_OK);
+	TEST_CHECK(parameters.apply());
+	TEST_CHECK(parameters.getInt(PARAM_ESC_FREQUENCY_HZ) == 100);
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 4.5f);
+}
+
+static void testConsistency()
+{
+	ParameterStore parameters;
+
+	//Min duty above max duty would invert the throttle
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_MIN_DUTY, 12) == PARAM_OK);
+	TEST_CHECK(parameters.commit() == PARAM_INCONSISTENT);
+	TEST_CHECK(!parameters.apply());
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 5.0f);
+
+	//Fixing the other end of the range lets the pair through together
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_MAX_DUTY, 15) == PARAM_OK);
+	TEST_CHECK(parameters.commit() == PARAM_OK);
+	TEST_CHECK(parameters.apply());
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 12.0f);
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MAX_DUTY) == 15.0f);
+
+	TEST_CHECK(strcmp(ParameterStore::getResultName(PARAM_INCONSISTENT), "conflicts with another parameter") == 0);
+}
+
+static void testCommitSnapshot()
+{
+	ParameterStore parameters;
+
+	TEST_CHECK(parameters.setInt(PARAM_FAILSAFE_HOLD_MS, 500) == PARAM_OK);
+	TEST_CHECK(parameters.commit() == PARAM_OK);
+
+	//An edit after a good commit, refused by its own commit, must not ride along with the earlier one
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_MIN_DUTY, 12) == PARAM_OK);
+	TEST_CHECK(parameters.commit() == PARAM_INCONSISTENT);
+	TEST_CHECK(parameters.apply());
+	TEST_CHECK(parameters.getInt(PARAM_FAILSAFE_HOLD_MS) == 500);
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 5.0f);
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) < parameters.getFloat(PARAM_ESC_MAX_DUTY));
+
+	//Uncommitted edits wait for the next commit
+	TEST_CHECK(parameters.setFloat(PARAM_ESC_MIN_DUTY, 6) == PARAM_OK);
+	TEST_CHECK(!parameters.apply());
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 5.0f);
+	TEST_CHECK(parameters.commit() == PARAM_OK);
+	TEST_CHECK(parameters.setInt(PARAM_FAILSAFE_HOLD_MS, 750) == PARAM_OK);
+	TEST_CHECK(parameters.apply());
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 6.0f);
+	TEST_CHECK(parameters.getInt(PARAM_FAILSAFE_HOLD_MS) == 500);
+
+	//Committing again after a swap fills the other bank with everything staged so far
+	TEST_CHECK(parameters.commit() == PARAM_OK);
+	TEST_CHECK(parameters.apply());
+	TEST_CHECK(parameters.getFloat(PARAM_ESC_MIN_DUTY) == 6.0f);
+	TEST_CHECK(parameters.getInt(PARAM_FAILSAFE_HOLD_MS) == 750);
+}
+
+static void testBlob()
+{
+	ParameterStore source;
+	uint8_t blob[PARAMETER_BLOB_MAX_SIZE];
+
+	TEST_CHECK(source.setInt(PARAM_FAILSAFE_MISSED_TICKS, 5) == PARAM_OK);
+	TEST_CHECK(source.setFloat(PARAM_ESC_THRUST_EXPO, .25) == PARAM_OK);
+	TEST_CHECK(source.commit() == PARAM_OK);
+	TEST_CHECK(source.apply());
+
+	uint32_t size = source.serialize(blob, sizeof(blob));
+	TEST_CHECK(size == PARAMETER_BLOB_MAX_SIZE);
+
+	ParameterStore copy;
+	TEST_CHECK(copy.deserialize(blob, size));
+	TEST_CHECK(copy.apply());
+	TEST_CHECK(copy.getInt(PARAM_FAILSAFE_MISSED_TICKS) == 5);
+	TEST_CHECK(copy.getFloat(PARAM_ESC_THRUST_EXPO) == .25f);
+
+	TEST_CHECK(!copy.deserialize(blob, PARAMETER_BLOB_HEADER_SIZE - 1));
+
+	//Blobs from before a layout change are ignored rather than read into shifted positions
+	uint8_t oldVersion[PARAMETER_BLOB_MAX_SIZE];
+	memcpy(oldVersion, blob, size);
+	oldVersion[4] = PARAMETER_BLOB_VERSION - 1;
+	TEST_CHECK(!copy.deserialize(oldVersion, size));
+
+	uint8_t corrupt[PARAMETER_BLOB_MAX_SIZE];
+	memcpy(corrupt, blob, size);
+	corrupt[PARAMETER_BLOB_HEADER_SIZE] ^= 1;
+	TEST_CHECK(!copy.deserialize(corrupt, size));
+
+	//A blob with a valid checksum but an out of range value is rejected whole
+	ParameterStore unchecked;
+	ParameterStore defaults;
+	memcpy(corrupt, blob, size);
+	corrupt[PARAMETER_BLOB_HEADER_SIZE + PARAM_ESC_FREQUENCY_HZ * 4] = 0;
+	corrupt[PARAMETER_BLOB_HEADER_SIZE + PARAM_ESC_FREQUENCY_HZ * 4 + 1] = 0;
+
+	uint32_t hash = 2166136261u;
+
+	for(uint32_t i = PARAMETER_BLOB_HEADER_SIZE; i < size; i++)
+	{
+		hash ^= corrupt[i];
+		hash *= 16777619u;
+	}
+
+	for(int i = 0; i < 4; i++)
+		corrupt[8 + i] = hash >> (8 * i);
+
+	TEST_CHECK(!unchecked.deserialize(corrupt, size));
+	TEST_CHECK(!unchecked.apply());
+	TEST_CHECK(unchecked.getInt(PARAM_ESC_FREQUENCY_HZ) == defaults.getInt(PARAM_ESC_FREQUENCY_HZ));
+}
+
+int main()
+{
+	testRanges();
+	testParsing();
+	testConsistency();
+	testCommitSnapshot();
+	testBlob();
+	return TEST_REPORT("test_parameters");
+}
@@ -0,0 +1,212 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "TestUtil.h"
+#include "Profiler.h"
+#include "ESCControl.h"
+#include <string.h>
+
+/*
+ * Built with FC_PROFILING: checks the histogram buckets, the statistics, reset() and the dump format,
+ * and that the probes in the library record their calls.
+ */
+
+#ifndef FC_PROFILING
+#error test_profiler must be built with -DFC_PROFILING
+#endif
+
+#define TEST_LINE_LENGTH 512
+
+/**
+ * @brief Record a single sample and find the bucket it landed in
+ *
+ * @return The bucket index, or -1 if the sample was not counted exactly once
+ */
+static int findBucket(uint32_t cycles)
+{
+	Profiler::reset();
+	Profiler::record(PROBE_ACCEL_UPDATE, cycles);
+
+	const ProfileHistogram * histogram = Profiler::getHistogram(PROBE_ACCEL_UPDATE);
+	int bucket = -1;
+
+	for(int i = 0; i < PROFILER_HISTOGRAM_BUCKETS; i++)
+	{
+		if(histogram->buckets[i] == 1 && bucket < 0)
+			bucket = i;
+		else if(histogram->buckets[i] != 0)
+			return -1;
+	}
+
+	return bucket;
+}
+
+static void testBuckets()
+{
+	//Bucket n holds 2^n to 2^(n+1) - 1 cycles, with 0 cycles in the first bucket
+	TEST_CHECK(findBucket(0) == 0);
+	TEST_CHECK(findBucket(1) == 0);
+	TEST_CHECK(findBucket(2) == 1);
+	TEST_CHECK(findBucket(3) == 1);
+	TEST_CHECK(findBucket(4) == 2);
+	TEST_CHECK(findBucket(1023) == 9);
+	TEST_CHECK(findBucket(1024) == 10);
+	TEST_CHECK(findBucket(1u << (PROFILER_HISTOGRAM_BUCKETS - 1)) == PROFILER_HISTOGRAM_BUCKETS - 1);
+
+	//Anything longer lands in the last bucket
+	TEST_CHECK(findBucket(1u << PROFILER_HISTOGRAM_BUCKETS) == PROFILER_HISTOGRAM_BUCKETS - 1);
+	TEST_CHECK(findBucket(UINT32_MAX) == PROFILER_HISTOGRAM_BUCKETS - 1);
+}
+
+static void testStatistics()
+{
+	Profiler::reset();
+	const ProfileHistogram * histogram = Profiler::getHistogram(PROBE_ESC_SET_RPM);
+
+	//The minimum and maximum follow the samples whatever their order
+	Profiler::record(PROBE_ESC_SET_RPM, 20);
+	Profiler::record(PROBE_ESC_SET_RPM, 10);
+	Profiler::record(PROBE_ESC_SET_RPM, 61);
+
+	TEST_CHECK(histogram->count == 3);
+	TEST_CHECK(histogram->minCycles == 10);
+	TEST_CHECK(histogram->maxCycles == 61);
+	TEST_CHECK(histogram->totalCycles == 91);
+
+	//Probes are kept apart
+	TEST_CHECK(Profiler::getHistogram(PROBE_ESC_SET_THRUST)->count == 0);
+
+	//The total does not wrap at 32 bits
+	Profiler::record(PROBE_ESC_SET_RPM, UINT32_MAX);
+	Profiler::record(PROBE_ESC_SET_RPM, UINT32_MAX);
+	TEST_CHECK(histogram->totalCycles == 91 + 2ull * UINT32_MAX);
+
+	//Reset clears every probe
+	Profiler::record(PROBE_THROTTLE_ALL, 5);
+	Profiler::reset();
+
+	for(int i = 0; i < NUM_PROFILE_PROBES; i++)
+	{
+		const ProfileHistogram * cleared = Profiler::getHistogram((ProfileProbe)i);
+		bool empty = cleared->count == 0 && cleared->minCycles == 0 && cleared->maxCycles == 0 && cleared->totalCycles == 0;
+
+		for(int j = 0; j < PROFILER_HISTOGRAM_BUCKETS; j++)
+			empty = empty && cleared->buckets[j] == 0;
+
+		TEST_CHECK(empty);
+	}
+
+	//A zero cycle first sample is still the minimum
+	Profiler::record(PROBE_THROTTLE_ALL, 0);
+	Profiler::record(PROBE_THROTTLE_ALL, 7);
+	TEST_CHECK(Profiler::getHistogram(PROBE_THROTTLE_ALL)->minCycles == 0);
+}
+
+static void testDump()
+{
+	Profiler::reset();
+	Profiler::record(PROBE_ACCEL_UPDATE, 10);
+	Profiler::record(PROBE_ACCEL_UPDATE, 20);
+	Profiler::record(PROBE_ACCEL_UPDATE, 61);
+
+	FILE * file = tmpfile();
+	TEST_CHECK(file != 0);
+
+	if(file == 0)
+		return;
+
+	Profiler::dump(file);
+	rewind(file);
+
+	TEST_CHECK(strcmp(Profiler::getProbeName(PROBE_THROTTLE_ALL), "throttle_all") == 0);
+
+	//One line per probe in enum order, the mean rounded down
+	const char * expected[NUM_PROFILE_PROBES] =
+	{
+		"accel_update count=3 min=10 mean=30 max=61 hist=0,0,0,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0\n",
+		"esc_set_rpm count=0 min=0 mean=0 max=0 hist=0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0\n",
+		"esc_set_thrust count=0 min=0 mean=0 max=0 hist=0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0\n",
+		"throttle_all count=0 min=0 mean=0 max=0 hist=0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0\n"
+	};
+
+	char line[TEST_LINE_LENGTH];
+
+	for(int i = 0; i < NUM_PROFILE_PROBES; i++)
+		TEST_CHECK(fgets(line, sizeof(line), file) != 0 && strcmp(line, expected[i]) == 0);
+
+	TEST_CHECK(fgets(line, sizeof(line), file) == 0);
+	fclose(file);
+
+	//The largest values still fit on the line
+	Profiler::reset();
+
+	for(int i = 0; i < PROFILER_HISTOGRAM_BUCKETS; i++)
+		Profiler::record(PROBE_THROTTLE_ALL, UINT32_MAX);
+
+	file = tmpfile();
+
+	if(file == 0)
+		return;
+
+	Profiler::dump(file);
+	rewind(file);
+
+	for(int i = 0; i < NUM_PROFILE_PROBES; i++)
+		TEST_CHECK(fgets(line, sizeof(line), file) != 0);
+
+	TEST_CHECK(strstr(line, "max=4294967295 hist=0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,24\n") != 0);
+	fclose(file);
+}
+
+static void testLibraryProbes()
+{
+	mcpwm_stub_reset();
+	ESCControl esc(PIN_A0, MCPWM_UNIT_0, MCPWM_TIMER_0);
+
+	TEST_CHECK(esc.init());
+	TEST_CHECK(esc.start());
+
+	Profiler::reset();
+	TEST_CHECK(esc.setRPMPercentage(50));
+	TEST_CHECK(esc.setThrustPercentage(50));
+	TEST_CHECK(esc.setThrustPercentage(60));
+
+	TEST_CHECK(Profiler::getHistogram(PROBE_ESC_SET_RPM)->count == 1);
+	TEST_CHECK(Profiler::getHistogram(PROBE_ESC_SET_THRUST)->count == 2);
+	TEST_CHECK(Profiler::getHistogram(PROBE_ACCEL_UPDATE)->count == 0);
+
+	//A scope records once when it exits
+	{
+		FC_PROFILE_SCOPE(PROBE_ACCEL_UPDATE);
+	}
+
+	TEST_CHECK(Profiler::getHistogram(PROBE_ACCEL_UPDATE)->count == 1);
+}
+
+int main()
+{
+	testBuckets();
+	testStatistics();
+	testDump();
+	testLibraryProbes();
+	return TEST_REPORT("test_profiler");
+}
@@ -0,0 +1,389 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "TestUtil.h"
+#include "Telemetry.h"
+#include <string.h>
+
+/*
+ * Decodes every frame with a reference receiver that only knows the documented wire format, over a lossy
+ * acknowledgement channel and a simulated link slower than the fields ask for.
+ */
+
+#define SIM_DURATION_MS 20000
+#define SIM_SETTLE_MS 5000
+#define SIM_TX_BUFFER_SIZE 128
+
+/**
+ * @brief Receiver side of the link, keeping decoded copies of recent frames to resolve references
+ */
+typedef struct
+{
+	int32_t history[TELEMETRY_HISTORY][TELEMETRY_MAX_FIELDS];
+	uint8_t historySequence[TELEMETRY_HISTORY];
+	bool historyValid[TELEMETRY_HISTORY];
+
+	//The most recently decoded frame, and which fields it carried
+	int32_t decoded[TELEMETRY_MAX_FIELDS];
+	bool sent[TELEMETRY_MAX_FIELDS];
+
+	uint32_t frames;
+	uint32_t absoluteFrames;
+	uint32_t errors;
+} Receiver;
+
+static uint32_t randomState = 2024;
+
+static uint32_t nextRandom()
+{
+	randomState = randomState * 1103515245u + 12345u;
+	return randomState >> 8;
+}
+
+static uint8_t crc8(const uint8_t * data, uint8_t length)
+{
+	uint8_t crc = 0;
+
+	for(uint8_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+
+		for(uint8_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+
+	return crc;
+}
+
+/**
+ * @brief Decode a frame into receiver->decoded
+ *
+ * @return
+ * 		- true frame decoded
+ * 		- false bad sync, CRC or reference, counted as an error
+ */
+static bool decodeFrame(Receiver * receiver, const uint8_t * frame)
+{
+	receiver->frames++;
+
+	if(frame[0] != TELEMETRY_SYNC_BYTE || frame[TELEMETRY_FRAME_SIZE - 1] != crc8(frame, TELEMETRY_FRAME_SIZE - 1))
+	{
+		receiver->errors++;
+		return false;
+	}
+
+	uint8_t sequence = frame[1];
+	uint8_t reference = frame[2];
+	uint8_t count = frame[3];
+	int32_t values[TELEMETRY_MAX_FIELDS];
+
+	if(reference == sequence)
+	{
+		memset(values, 0, sizeof(values));
+		receiver->absoluteFrames++;
+	}
+	else
+	{
+		uint8_t slot = reference & (TELEMETRY_HISTORY - 1);
+
+		if(!receiver->historyValid[slot] || receiver->historySequence[slot] != reference)
+		{
+			receiver->errors++;
+			return false;
+		}
+
+		memcpy(values, receiver->history[slot], sizeof(values));
+	}
+
+	memset(receiver->sent, 0, sizeof(receiver->sent));
+	uint8_t position = TELEMETRY_HEADER_SIZE;
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		uint8_t field = frame[position++];
+		uint32_t encoded = 0;
+		uint8_t shift = 0;
+
+		do
+		{
+			encoded |= (uint32_t)(frame[position] & 0x7f) << shift;
+			shift += 7;
+		} while(frame[position++] & 0x80);
+
+		int32_t delta = (int32_t)(encoded >> 1) ^ -(int32_t)(encoded & 1);
+		values[field] = (int32_t)((uint32_t)values[field] + (uint32_t)delta);
+		receiver->sent[field] = true;
+	}
+
+	uint8_t slot = sequence & (TELEMETRY_HISTORY - 1);
+	memcpy(receiver->history[slot], values, sizeof(values));
+	receiver->historySequence[slot] = sequence;
+	receiver->historyValid[slot] = true;
+	memcpy(receiver->decoded, values, sizeof(values));
+	return true;
+}
+
+//Fields in the decoded frame that differ from what the scheduler was given
+static uint32_t countMismatches(const Receiver * receiver, const int32_t * values, int numFields)
+{
+	uint32_t mismatches = 0;
+
+	for(int field = 0; field < numFields; field++)
+	{
+		if(receiver->sent[field] && receiver->decoded[field] != values[field])
+			mismatches++;
+	}
+
+	return mismatches;
+}
+
+static void updateValues(TelemetryScheduler * telemetry, int32_t * values, int numFields, uint32_t nowMs)
+{
+	for(int field = 0; field < numFields; field++)
+	{
+		//Mostly small changes with the occasional large jump, so varints of every length are exercised
+		if(nextRandom() % 50 == 0)
+			values[field] = (int32_t)(nextRandom() * 2654435761u);
+		else
+			values[field] += (int32_t)(nextRandom() % 201) - 100 + (int32_t)(nowMs % 7);
+
+		telemetry->setValue(field, values[field]);
+	}
+}
+
+static void testRoundTrip()
+{
+	TelemetryScheduler telemetry;
+	Receiver receiver;
+	int32_t values[TELEMETRY_MAX_FIELDS];
+	uint32_t mismatches = 0;
+
+	memset(&receiver, 0, sizeof(receiver));
+	memset(values, 0, sizeof(values));
+
+	for(int i = 0; i < 3; i++)
+		telemetry.addField(100, TELEMETRY_CRITICAL_PRIORITY);
+
+	for(int i = 0; i < 5; i++)
+		telemetry.addField(50, 100);
+
+	telemetry.addField(2, 50);
+
+	uint8_t frame[TELEMETRY_FRAME_SIZE];
+	uint32_t absoluteBeforeOutage = 0;
+
+	for(uint32_t nowMs = 0; nowMs < 10000; nowMs++)
+	{
+		updateValues(&telemetry, values, 9, nowMs);
+
+		if(telemetry.buildFrame(nowMs, frame) == 0)
+			continue;
+
+		if(!decodeFrame(&receiver, frame))
+			continue;
+
+		mismatches += countMismatches(&receiver, values, 9);
+
+		if(nowMs == 6000)
+			absoluteBeforeOutage = receiver.absoluteFrames;
+
+		//A quarter of acknowledgements are lost, and none get through from 6s to 7s
+		if(nextRandom() % 4 != 0 && (nowMs < 6000 || nowMs >= 7000))
+			telemetry.acknowledge(frame[1]);
+	}
+
+	printf("round trip: %u frames, %u absolute, %u decode errors, %u mismatched fields\n", (unsigned)receiver.frames,
+		(unsigned)receiver.absoluteFrames, (unsigned)receiver.errors, (unsigned)mismatches);
+
+	TEST_CHECK(receiver.frames > 1000);
+	TEST_CHECK(receiver.errors == 0);
+	TEST_CHECK(mismatches == 0);
+
+	//Without acknowledgements the scheduler falls back to absolute values once the reference ages out
+	TEST_CHECK(receiver.absoluteFrames - absoluteBeforeOutage > 50);
+
+	//A corrupted frame is caught by the CRC
+	TEST_CHECK(telemetry.buildFrame(20000, frame) != 0);
+	frame[5] ^= 0x10;
+	TEST_CHECK(!decodeFrame(&receiver, frame));
+}
+
+typedef struct
+{
+	uint32_t bytesPerSecond;
+	uint32_t blockedMs;
+	uint32_t congestionEpisodes;
+	uint32_t criticalSends;
+	uint32_t nonCriticalSends;
+	uint32_t errors;
+	uint32_t mismatches;
+	uint16_t rateScale;
+	uint32_t linkBudget;
+} LinkResult;
+
+/**
+ * @brief Run the scheduler over a link that drains its transmit buffer at a fixed rate
+ *
+ * @param linkBytesPerSecond The rate the link drains at
+ * @param budget The budget passed to setLinkBudget, 0 to learn it
+ *
+ * @return What got through after the rates had time to settle
+ */
+static LinkResult simulateSlowLink(uint32_t linkBytesPerSecond, uint32_t budget)
+{
+	TelemetryScheduler telemetry;
+	Receiver receiver;
+	int32_t values[TELEMETRY_MAX_FIELDS];
+	LinkResult result;
+
+	memset(&receiver, 0, sizeof(receiver));
+	memset(values, 0, sizeof(values));
+	memset(&result, 0, sizeof(result));
+
+	//Attitude is critical at 20Hz, six more fields want 50Hz, together far more than the link carries
+	for(int i = 0; i < 3; i++)
+		telemetry.addField(20, TELEMETRY_CRITICAL_PRIORITY);
+
+	for(int i = 0; i < 6; i++)
+		telemetry.addField(50, 100);
+
+	telemetry.setLinkBudget(budget);
+
+	//Bytes waiting in the transmit buffer in thousandths, drained every millisecond
+	uint32_t queuedMilliBytes = 0;
+	uint32_t sentBytes = 0;
+	bool congested = false;
+	uint8_t frame[TELEMETRY_FRAME_SIZE];
+
+	for(uint32_t nowMs = 0; nowMs < SIM_DURATION_MS; nowMs++)
+	{
+		uint32_t drained = linkBytesPerSecond;
+		queuedMilliBytes = queuedMilliBytes > drained ? queuedMilliBytes - drained : 0;
+
+		updateValues(&telemetry, values, 9, nowMs);
+
+		if(!telemetry.isDue(nowMs))
+			continue;
+
+		bool settled = nowMs >= SIM_SETTLE_MS;
+
+		if(SIM_TX_BUFFER_SIZE - queuedMilliBytes / 1000 < TELEMETRY_FRAME_SIZE)
+		{
+			telemetry.onCongestion(nowMs);
+
+			if(settled)
+			{
+				result.blockedMs++;
+
+				if(!congested)
+					result.congestionEpisodes++;
+			}
+
+			congested = true;
+			continue;
+		}
+
+		congested = false;
+
+		if(telemetry.buildFrame(nowMs, frame) == 0)
+			continue;
+
+		queuedMilliBytes += TELEMETRY_FRAME_SIZE * 1000;
+
+		if(decodeFrame(&receiver, frame))
+		{
+			result.mismatches += countMismatches(&receiver, values, 9);
+
+			if(settled)
+			{
+				for(int field = 0; field < 9; field++)
+				{
+					if(receiver.sent[field])
+					{
+						if(field < 3)
+							result.criticalSends++;
+						else
+							result.nonCriticalSends++;
+					}
+				}
+			}
+		}
+
+		if(settled)
+			sentBytes += TELEMETRY_FRAME_SIZE;
+
+		if(nextRandom() % 4 != 0)
+			telemetry.acknowledge(frame[1]);
+	}
+
+	result.bytesPerSecond = sentBytes * 1000 / (SIM_DURATION_MS - SIM_SETTLE_MS);
+	result.errors = receiver.errors;
+	result.rateScale = telemetry.getRateScale();
+	result.linkBudget = telemetry.getLinkBudget();
+
+	printf("slow link %u B/s budget %u: sent %u B/s, blocked %ums in %u episodes, critical %u/s, other %u/s, scale %u/256, learned budget %u, "
+		"%u errors, %u mismatches\n", (unsigned)linkBytesPerSecond, (unsigned)budget, (unsigned)result.bytesPerSecond,
+		(unsigned)result.blockedMs, (unsigned)result.congestionEpisodes, (unsigned)(result.criticalSends * 1000 / (SIM_DURATION_MS - SIM_SETTLE_MS)),
+		(unsigned)(result.nonCriticalSends * 1000 / (SIM_DURATION_MS - SIM_SETTLE_MS)), (unsigned)result.rateScale,
+		(unsigned)result.linkBudget, (unsigned)result.errors, (unsigned)result.mismatches);
+
+	return result;
+}
+
+static void testSlowLink()
+{
+	uint32_t settledSeconds = (SIM_DURATION_MS - SIM_SETTLE_MS) / 1000;
+
+	//Learning the budget from refused frames: rates come down and the link is kept busy, probing for more
+	//only rarely and briefly holds a frame back
+	LinkResult learned = simulateSlowLink(1000, 0);
+	TEST_CHECK(learned.errors == 0);
+	TEST_CHECK(learned.mismatches == 0);
+	TEST_CHECK(learned.rateScale < 256);
+	TEST_CHECK(learned.bytesPerSecond <= 1000);
+	TEST_CHECK(learned.bytesPerSecond >= 600);
+	TEST_CHECK(learned.congestionEpisodes < 2 * settledSeconds);
+	TEST_CHECK(learned.blockedMs < 20 * settledSeconds);
+	TEST_CHECK(learned.criticalSends >= 3 * 19 * settledSeconds);
+
+	//With the budget given up front the link is never overrun once settled
+	LinkResult configured = simulateSlowLink(1000, 900);
+	TEST_CHECK(configured.errors == 0);
+	TEST_CHECK(configured.mismatches == 0);
+	TEST_CHECK(configured.rateScale < 256);
+	TEST_CHECK(configured.bytesPerSecond <= 900 * 17 / 16);
+	TEST_CHECK(configured.blockedMs == 0);
+	TEST_CHECK(configured.criticalSends >= 3 * 19 * settledSeconds);
+
+	//A link with room to spare keeps every field at full rate
+	LinkResult fast = simulateSlowLink(20000, 0);
+	TEST_CHECK(fast.blockedMs == 0);
+	TEST_CHECK(fast.rateScale == 256);
+	TEST_CHECK(fast.nonCriticalSends >= 6 * 49 * settledSeconds);
+}
+
+int main()
+{
+	testRoundTrip();
+	testSlowLink();
+	return TEST_REPORT("test_telemetry");
+}
@@ -0,0 +1,254 @@
+/*
+* Copyright (c) 2020 Lena Voytek
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "TestUtil.h"
+#include "ThrottleCurve.h"
+#include "ESCControl.h"
+#include <math.h>
+
+//Default 50 Hz, 5% - 10% duty range, giving 1000 us - 2000 us pulses
+#define TEST_FREQUENCY 50
+#define TEST_MIN_PULSE 1000.0f
+#define TEST_MAX_PULSE 2000.0f
+
+//Largest allowed round trip error in percent of full thrust for the modelled curves
+#define TEST_MAX_CURVE_ERROR .4f
+
+/**
+ * @brief Find the worst round trip error of a curve against a thrust model over 0.1% steps
+ *
+ * @param curve The curve to check
+ * @param thrustExpo The quadratic share of the thrust model
+ *
+ * @return The largest difference in percent between requested thrust and modelled thrust at the returned pulse
+ */
+static float worstCurveError(const ThrottleCurve & curve, float thrustExpo)
+{
+	float worst = 0;
+
+	for(int step = 1; step <= 1000; step++)
+	{
+		float requested = step * .1f;
+		float command = (curve.getPulseWidth(requested) - TEST_MIN_PULSE) / (TEST_MAX_PULSE - TEST_MIN_PULSE);
+		float produced = 100.0f * ((1.0f - thrustExpo) * command + thrustExpo * command * command);
+		float error = fabsf(produced - requested);
+
+		if(error > worst)
+			worst = error;
+	}
+
+	return worst;
+}
+
+static void testModelledCurve()
+{
+	ThrottleCurve quadratic(TEST_FREQUENCY, 5, 10, 1.0);
+	float quadraticError = worstCurveError(quadratic, 1.0);
+	printf("quadratic curve worst error: %.3f%%\n", quadraticError);
+	TEST_CHECK(quadraticError <= TEST_MAX_CURVE_ERROR);
+
+	ThrottleCurve mixed(TEST_FREQUENCY, 5, 10, .5);
+	float mixedError = worstCurveError(mixed, .5);
+	printf("mixed curve worst error: %.3f%%\n", mixedError);
+	TEST_CHECK(mixedError <= TEST_MAX_CURVE_ERROR);
+
+	ThrottleCurve linear(TEST_FREQUENCY, 5, 10, 0.0);
+	float linearError = worstCurveError(linear, 0.0);
+	printf("linear curve worst error: %.3f%%\n", linearError);
+	TEST_CHECK(linearError <= TEST_MAX_CURVE_ERROR);
+
+	//Half thrust on a quadratic curve needs sqrt(.5) of the command range
+	TEST_CHECK(fabsf(quadratic.getPulseWidth(50) - (1000.0f + 1000.0f * sqrtf(.5f))) <= 1.0f);
+
+	//Out of range expo is clamped rather than extrapolated
+	ThrottleCurve clamped(TEST_FREQUENCY, 5, 10, 3.0);
+	TEST_CHECK(clamped.getPulseWidth(50) == quadratic.getPulseWidth(50));
+}
+
+static void testEdges()
+{
+	ThrottleCurve curve(TEST_FREQUENCY, 5, 10, 1.0);
+
+	TEST_CHECK(curve.getPulseWidth(0) == 0);
+	TEST_CHECK(curve.getPulseWidth(.005f) == 0);
+	TEST_CHECK(curve.getPulseWidth(-5) == 0);
+	TEST_CHECK(curve.getPulseWidth(NAN) == 0);
+	TEST_CHECK(curve.getPulseWidth(-INFINITY) == 0);
+
+	TEST_CHECK(curve.getPulseWidth(100) == 2000);
+	TEST_CHECK(curve.getPulseWidth(150) == 2000);
+	TEST_CHECK(curve.getPulseWidth(INFINITY) == 2000);
+
+	//The smallest non-zero request starts at the bottom of the duty range
+	TEST_CHECK(curve.getPulseWidth(.01f) >= 1000 && curve.getPulseWidth(.01f) < 1020);
+
+	//Output never decreases as thrust increases
+	uint32_t previous = 0;
+	bool monotonic = true;
+
+	for(int step = 0; step <= 10000; step++)
+	{
+		uint32_t pulse = curve.getPulseWidth(step * .01f);
+
+		if(pulse < previous)
+			monotonic = false;
+
+		previous = pulse;
+	}
+
+	TEST_CHECK(monotonic);
+}
+
+static void testMeasuredCurve()
+{
+	ThrottleCurve curve(TEST_FREQUENCY, 5, 10, 0.0);
+
+	//Measurements of a quadratic rotor in grams, offset by the thrust at min duty
+	float quadratic[9];
+
+	for(int i = 0; i < 9; i++)
+		quadratic[i] = 20.0f + 800.0f * (i / 8.0f) * (i / 8.0f);
+
+	TEST_CHECK(curve.setMeasuredCurve(quadratic, 9));
+	TEST_CHECK(curve.getPulseWidth(100) == 2000);
+	TEST_CHECK(curve.getPulseWidth(25) >= 1490 && curve.getPulseWidth(25) <= 1520);
+
+	//Rejected curves leave the table untouched
+	uint32_t before = curve.getPulseWidth(25);
+
+	float decreasing[4] = {0, 10, 5, 20};
+	TEST_CHECK(!curve.setMeasuredCurve(decreasing, 4));
+
+	float flat[3] = {5, 5, 5};
+	TEST_CHECK(!curve.setMeasuredCurve(flat, 3));
+
+	float inverted[3] = {20, 10, 0};
+	TEST_CHECK(!curve.setMeasuredCurve(inverted, 3));
+
+	float notANumber[3] = {0, NAN, 1};
+	TEST_CHECK(!curve.setMeasuredCurve(notANumber, 3));
+
+	float infinite[3] = {0, 1, INFINITY};
+	TEST_CHECK(!curve.setMeasuredCurve(infinite, 3));
+
+	TEST_CHECK(!curve.setMeasuredCurve(quadratic, 1));
+	TEST_CHECK(!curve.setMeasuredCurve(quadratic, 0));
+
+	float tooMany[THROTTLE_CURVE_MAX_MEASURED_POINTS + 1];
+
+	for(int i = 0; i <= THROTTLE_CURVE_MAX_MEASURED_POINTS; i++)
+		tooMany[i] = (float)i;
+
+	TEST_CHECK(!curve.setMeasuredCurve(tooMany, THROTTLE_CURVE_MAX_MEASURED_POINTS + 1));
+	TEST_CHECK(curve.setMeasuredCurve(tooMany, THROTTLE_CURVE_MAX_MEASURED_POINTS));
+	TEST_CHECK(curve.getPulseWidth(50) == 1500);
+
+	TEST_CHECK(curve.setMeasuredCurve(quadratic, 9));
+	TEST_CHECK(curve.getPulseWidth(25) == before);
+
+	//A plateau in the measurements is allowed, the lowest command reaching it is used
+	float plateau[5] = {0, 10, 10, 30, 40};
+	TEST_CHECK(curve.setMeasuredCurve(plateau, 5));
+	TEST_CHECK(curve.getPulseWidth(25) == 1250);
+}
+
+static void testESCOutput()
+{
+	mcpwm_stub_reset();
+	ESCControl esc(PIN_A0, MCPWM_UNIT_0, MCPWM_TIMER_0);
+	const mcpwm_stub_channel_t * channel = &mcpwmStubChannels[MCPWM_UNIT_0][MCPWM_TIMER_0];
+
+	TEST_CHECK(esc.init());
+	TEST_CHECK(esc.start());
+	TEST_CHECK(esc.getPulseWidth() == 0);
+
+	//Both setters report through the same active pulse width
+	TEST_CHECK(esc.setRPMPercentage(50));
+	TEST_CHECK(esc.getPulseWidth() == 1500);
+	TEST_CHECK(channel->pulseWidth == 1500);
+
+	TEST_CHECK(esc.setThrustPercentage(100));
+	TEST_CHECK(esc.getPulseWidth() == 2000);
+	TEST_CHECK(channel->pulseWidth == 2000);
+
+	TEST_CHECK(esc.setRPMPercentage(0));
+	TEST_CHECK(esc.getPulseWidth() == 0);
+
+	//A failed driver call leaves the recorded output alone
+	TEST_CHECK(esc.setThrustPercentage(25));
+	uint32_t active = esc.getPulseWidth();
+	mcpwmStubFail = true;
+	TEST_CHECK(!esc.setRPMPercentage(90));
+	TEST_CHECK(esc.getPulseWidth() == active);
+	mcpwmStubFail = false;
+
+	TEST_CHECK(esc.stop());
+	TEST_CHECK(esc.getPulseWidth() == 0);
+
+	//Configurations that would divide by zero or invert the throttle are refused
+	TEST_CHECK(!esc.configure(0, 5, 10, 1));
+	TEST_CHECK(!esc.configure(50, 10, 5, 1));
+	TEST_CHECK(!esc.configure(50, 0, 10, 1));
+	TEST_CHECK(esc.configure(400, 40, 80, 1));
+	TEST_CHECK(channel->frequency == 400);
+	TEST_CHECK(esc.getThrottleCurve()->getPulseWidth(100) == 2000);
+}
+
+static void testReconfigureKeepsMeasuredCurve()
+{
+	mcpwm_stub_reset();
+	ESCControl esc(PIN_A0, MCPWM_UNIT_0, MCPWM_TIMER_0);
+	float plateau[5] = {0, 10, 10, 30, 40};
+
+	TEST_CHECK(esc.init());
+	TEST_CHECK(esc.start());
+	TEST_CHECK(esc.getThrottleCurve()->setMeasuredCurve(plateau, 5));
+	TEST_CHECK(esc.setThrustPercentage(25));
+	TEST_CHECK(esc.getPulseWidth() == 1250);
+
+	//Pushing unchanged ESC parameters, as any committed parameter change does, keeps the measured curve
+	TEST_CHECK(esc.configure(ESC_DEFAULT_FREQUENCY_HZ, ESC_DEFAULT_MIN_DUTY, ESC_DEFAULT_MAX_DUTY, ESC_DEFAULT_THRUST_EXPO));
+	TEST_CHECK(esc.setThrustPercentage(25));
+	TEST_CHECK(esc.getPulseWidth() == 1250);
+
+	//A new duty range rescales the measured curve: a quarter of the way from 1000us to 1800us
+	TEST_CHECK(esc.configure(ESC_DEFAULT_FREQUENCY_HZ, 5, 9, ESC_DEFAULT_THRUST_EXPO));
+	TEST_CHECK(esc.setThrustPercentage(25));
+	TEST_CHECK(esc.getPulseWidth() == 1200);
+	TEST_CHECK(esc.getThrottleCurve()->getPulseWidth(100) == 1800);
+
+	//A new expo replaces it with the modelled curve
+	ThrottleCurve linear(ESC_DEFAULT_FREQUENCY_HZ, 5, 9, 0);
+	TEST_CHECK(esc.configure(ESC_DEFAULT_FREQUENCY_HZ, 5, 9, 0));
+	TEST_CHECK(esc.getThrottleCurve()->getPulseWidth(25) == linear.getPulseWidth(25));
+	TEST_CHECK(esc.getThrottleCurve()->getPulseWidth(60) == linear.getPulseWidth(60));
+}
+
+int main()
+{
+	testModelledCurve();
+	testEdges();
+	testMeasuredCurve();
+	testESCOutput();
+	testReconfigureKeepsMeasuredCurve();
+	return TEST_REPORT("test_throttle_curve");
+}